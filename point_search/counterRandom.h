@@ -0,0 +1,62 @@
+#pragma once
+#ifndef __COUNTER_RANDOM__
+#define __COUNTER_RANDOM__
+
+#include <stdint.h>
+
+/* Stateless random numbers: the value for a counter depends only on the key and the counter, so any thread can
+   produce any part of a sequence and the whole sequence is the same however the work is split.  Values are
+   splitmix64 outputs, the state for counter n being key + (n + 1) * golden ratio. */
+
+/* increment of splitmix64's state, 2^64 / golden ratio */
+#define COUNTER_RANDOM_GAMMA 0x9E3779B97F4A7C15ull
+
+/* splitmix64 finalizer, a bijective mix of all 64 bits */
+inline uint64_t mix64(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+/* key of an independent stream of a seed, so points and query rects never share values */
+inline uint64_t stream_key(uint64_t seed, uint64_t stream)
+{
+	return mix64(seed ^ mix64(stream * COUNTER_RANDOM_GAMMA));
+}
+
+/* random 64 bits for counter of the stream with key */
+inline uint64_t counter_random(uint64_t key, uint64_t counter)
+{
+	return mix64(key + (counter + 1) * COUNTER_RANDOM_GAMMA);
+}
+
+/* uniform double in [-0.5, 0.5) from the top 53 bits of random */
+inline double centered_unit(uint64_t random)
+{
+	return (double)(random >> 11) * (1.0 / 9007199254740992.0) - 0.5;
+}
+
+/* keyed bijection of 32 bit values, a 4 round Feistel network on 16 bit halves */
+inline uint32_t permute32(uint32_t value, uint64_t key)
+{
+	uint32_t left = value >> 16, right = value & 0xFFFFu;
+	for (uint64_t round = 0; round < 4; round++)
+	{
+		uint32_t f = (uint32_t)counter_random(key, (round << 16) | right) & 0xFFFFu;
+		uint32_t t = right;
+		right = left ^ f;
+		left = t;
+	}
+	return (left << 16) | right;
+}
+
+/* keyed bijection of [0, 2^31), walking the cycle of the 32 bit permutation until it lands back in range, so
+   distinct values always give distinct results */
+inline uint32_t permute31(uint32_t value, uint64_t key)
+{
+	do value = permute32(value, key); while (value >= 0x80000000u);
+	return value;
+}
+
+#endif /* __COUNTER_RANDOM__ */
@@ -0,0 +1,173 @@
+#define _CRT_SECURE_NO_WARNINGS /* _tfopen */
+#include "dataFile.h"
+#include <stdio.h>
+#include <string.h>   /* for memcmp, memcpy, memset */
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* most bytes handed to one fwrite call, so arrays of many GB are written by runtimes with 32 bit counts too */
+#define DATA_FILE_WRITE_CHUNK (1 << 26)
+
+/* next multiple of DATA_FILE_ALIGNMENT at or after offset */
+static inline uint64_t alignData(uint64_t offset)
+{
+	return (offset + DATA_FILE_ALIGNMENT - 1) / DATA_FILE_ALIGNMENT * DATA_FILE_ALIGNMENT;
+}
+
+/* writes bytes at data, or zeros if data is NULL, returns false on any failure */
+static bool writeBytes(FILE *f, const void *data, uint64_t bytes)
+{
+	static const char padding[DATA_FILE_ALIGNMENT] = { 0 };
+	const char *from = (const char *)data;
+	while (bytes > 0)
+	{
+		size_t size = (size_t)((bytes < DATA_FILE_WRITE_CHUNK) ? bytes : DATA_FILE_WRITE_CHUNK);
+		if (from == NULL) {
+			if (size > sizeof(padding)) size = sizeof(padding);
+			if (fwrite(padding, 1, size, f) != size) return false;
+		} else {
+			if (fwrite(from, 1, size, f) != size) return false;
+			from += size;
+		}
+		bytes -= size;
+	}
+	return true;
+}
+
+/* writes pointCount points and queryCount rects to path, returns false if it could not be written completely */
+bool dataFile::write(const TCHAR *path, const Point *points, uint64_t pointCount, const Rect *rects, uint64_t queryCount,
+	const int32_t randomSeed[4])
+{
+	dataFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DATA_FILE_MAGIC, sizeof(header.magic));
+	header.version = DATA_FILE_VERSION;
+	header.endianTag = DATA_FILE_ENDIAN_TAG;
+	header.pointBytes = (uint32_t)sizeof(Point);
+	header.rectBytes = (uint32_t)sizeof(Rect);
+	memcpy(header.randomSeed, randomSeed, sizeof(header.randomSeed));
+	header.pointCount = pointCount;
+	header.pointOffset = alignData(sizeof(header));
+	header.queryCount = queryCount;
+	header.queryOffset = alignData(header.pointOffset + pointCount * sizeof(Point));
+	header.fileBytes = alignData(header.queryOffset + queryCount * sizeof(Rect));
+
+	FILE *f = _tfopen(path, _T("wb"));
+	if (f == NULL) return false;
+	uint64_t pointsEnd = header.pointOffset + pointCount * sizeof(Point), rectsEnd = header.queryOffset + queryCount * sizeof(Rect);
+	bool ok = writeBytes(f, &header, sizeof(header)) && writeBytes(f, NULL, header.pointOffset - sizeof(header)) &&
+		writeBytes(f, points, pointCount * sizeof(Point)) && writeBytes(f, NULL, header.queryOffset - pointsEnd) &&
+		writeBytes(f, rects, queryCount * sizeof(Rect)) && writeBytes(f, NULL, header.fileBytes - rectsEnd);
+	ok = (fclose(f) == 0) && ok;
+	if (!ok) _tremove(path);
+	return ok;
+}
+
+
+dataFile::dataFile(void)
+{
+	m_base = NULL;
+	m_bytes = 0;
+#ifdef _WIN32
+	m_file = m_mapping = NULL;
+#else
+	m_file = -1;
+#endif
+}
+
+dataFile::~dataFile(void)
+{
+	close();
+}
+
+/* maps path and checks its header, returns false (with nothing mapped) if it is not a usable data file */
+bool dataFile::open(const TCHAR *path)
+{
+	close();
+	uint64_t size;
+#ifdef _WIN32
+	HANDLE f = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE) return false;
+	m_file = f;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(f, &fileSize)) { close(); return false; }
+	size = (uint64_t)fileSize.QuadPart;
+#else
+	m_file = ::open(path, O_RDONLY);
+	if (m_file < 0) return false;
+	struct stat st;
+	if (fstat(m_file, &st) != 0) { close(); return false; }
+	size = (uint64_t)st.st_size;
+#endif
+	/* a file too large for the address space (a 32 bit build) cannot be mapped whole */
+	if ((size < sizeof(dataFileHeader)) || (size > (uint64_t)(size_t)-1)) { close(); return false; }
+	m_bytes = (size_t)size;
+#ifdef _WIN32
+	m_mapping = CreateFileMapping(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping == NULL) { close(); return false; }
+	m_base = (const uint8_t *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	void *map = mmap(NULL, m_bytes, PROT_READ, MAP_SHARED, m_file, 0);
+	m_base = (map == MAP_FAILED) ? NULL : (const uint8_t *)map;
+#endif
+	if (m_base == NULL) { close(); return false; }
+
+	/* only the header is checked, points and rects are used as they are */
+	const dataFileHeader &header = *(const dataFileHeader *)m_base;
+	bool ok = (memcmp(header.magic, DATA_FILE_MAGIC, sizeof(header.magic)) == 0) && (header.version == DATA_FILE_VERSION) &&
+		(header.endianTag == DATA_FILE_ENDIAN_TAG) && (header.pointBytes == sizeof(Point)) && (header.rectBytes == sizeof(Rect)) &&
+		(header.fileBytes == size) && (header.pointOffset % DATA_FILE_ALIGNMENT == 0) && (header.queryOffset % DATA_FILE_ALIGNMENT == 0) &&
+		(header.pointOffset <= size) && (header.pointCount <= (size - header.pointOffset) / sizeof(Point)) &&
+		(header.queryOffset <= size) && (header.queryCount <= (size - header.queryOffset) / sizeof(Rect));
+	if (!ok) close();
+	return ok;
+}
+
+/* unmaps the file, anything using its points or rects must be done first */
+void dataFile::close(void)
+{
+#ifdef _WIN32
+	if (m_base != NULL) UnmapViewOfFile(m_base);
+	if (m_mapping != NULL) CloseHandle(m_mapping);
+	if (m_file != NULL) CloseHandle(m_file);
+	m_file = m_mapping = NULL;
+#else
+	if (m_base != NULL) munmap((void *)m_base, m_bytes);
+	if (m_file >= 0) ::close(m_file);
+	m_file = -1;
+#endif
+	m_base = NULL;
+	m_bytes = 0;
+}
+
+/* contents of the mapped file, NULL and 0 if none */
+const Point *dataFile::points(void) const
+{
+	return (m_base == NULL) ? NULL : (const Point *)(m_base + ((const dataFileHeader *)m_base)->pointOffset);
+}
+
+uint64_t dataFile::pointCount(void) const
+{
+	return (m_base == NULL) ? 0 : ((const dataFileHeader *)m_base)->pointCount;
+}
+
+const Rect *dataFile::rects(void) const
+{
+	return (m_base == NULL) ? NULL : (const Rect *)(m_base + ((const dataFileHeader *)m_base)->queryOffset);
+}
+
+uint64_t dataFile::queryCount(void) const
+{
+	return (m_base == NULL) ? 0 : ((const dataFileHeader *)m_base)->queryCount;
+}
+
+const int32_t *dataFile::randomSeed(void) const
+{
+	return (m_base == NULL) ? NULL : ((const dataFileHeader *)m_base)->randomSeed;
+}
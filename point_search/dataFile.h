@@ -0,0 +1,75 @@
+#pragma once
+#ifndef __DATA_FILE__
+#define __DATA_FILE__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <tchar.h>
+#include "point_search.h"
+
+/* first bytes of every data file */
+#define DATA_FILE_MAGIC "PTSDATA"
+/* bumped whenever the layout changes, older files are then refused */
+#define DATA_FILE_VERSION 1
+/* written as is, so a file from a machine of other byte order reads back differently and is refused */
+#define DATA_FILE_ENDIAN_TAG 0x01020304u
+/* points and rects each start on a page boundary of the file, so their mapping is aligned for any element */
+#define DATA_FILE_ALIGNMENT 4096
+
+/* start of every data file, padded to DATA_FILE_ALIGNMENT, offsets are from the start of the file */
+struct dataFileHeader {
+	char magic[8];              /* DATA_FILE_MAGIC with its terminator */
+	uint32_t version;           /* DATA_FILE_VERSION                   */
+	uint32_t endianTag;         /* DATA_FILE_ENDIAN_TAG                */
+	uint32_t pointBytes;        /* sizeof(Point) of the writer         */
+	uint32_t rectBytes;         /* sizeof(Rect) of the writer          */
+	int32_t randomSeed[4];      /* seed the data came from, or 0s      */
+	uint64_t pointCount;
+	uint64_t pointOffset;       /* byte offset of first Point          */
+	uint64_t queryCount;
+	uint64_t queryOffset;       /* byte offset of first query Rect     */
+	uint64_t fileBytes;         /* total size of the file              */
+};
+
+/* Points to search and query rects to search them with, saved so a run can be repeated without generating them
+   again or replay a workload captured elsewhere.  Opening maps the file read only and nothing is read until used,
+   so the Points go straight from the page cache to create() and files larger than memory can be loaded. */
+class dataFile
+{
+public:
+	dataFile(void);
+	~dataFile(void);
+
+	/* writes pointCount points and queryCount rects to path, returns false if it could not be written completely */
+	static bool write(const TCHAR *path, const Point *points, uint64_t pointCount, const Rect *rects, uint64_t queryCount,
+		const int32_t randomSeed[4]);
+
+	/* maps path and checks its header, returns false (with nothing mapped) if it is not a usable data file */
+	bool open(const TCHAR *path);
+
+	/* unmaps the file, anything using its points or rects must be done first */
+	void close(void);
+
+	/* contents of the mapped file, NULL and 0 if none */
+	const Point *points(void) const;
+	uint64_t pointCount(void) const;
+	const Rect *rects(void) const;
+	uint64_t queryCount(void) const;
+	const int32_t *randomSeed(void) const;
+
+private:
+	/* not copyable */
+	dataFile(const dataFile &);
+	dataFile &operator=(const dataFile &);
+
+	const uint8_t *m_base;      /* start of mapping, NULL if none */
+	size_t m_bytes;
+#ifdef _WIN32
+	void *m_file;               /* HANDLE of file and of its mapping */
+	void *m_mapping;
+#else
+	int m_file;
+#endif
+};
+
+#endif /* __DATA_FILE__ */
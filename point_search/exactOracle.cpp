@@ -0,0 +1,144 @@
+#include "exactOracle.h"
+#include <string.h>   /* for memcmp */
+#include <algorithm>  /* for std::sort, std::inplace_merge, std::partial_sort, std::lower_bound, std::upper_bound */
+#include "parallel.h"
+
+/* queries a thread takes at a time while computing expected results */
+#define ORACLE_QUERY_CHUNK 64
+
+/* orderings of Points used by the oracle */
+static bool rankLess(const Point &a, const Point &b) { return a.rank < b.rank; }
+static bool xLess(const Point &a, const Point &b) { return a.x < b.x; }
+static bool xBelow(const Point &p, float x) { return p.x < x; }
+static bool xAbove(float x, const Point &p) { return x < p.x; }
+static bool bytesLess(const Point &a, const Point &b) { return memcmp(&a, &b, sizeof(Point)) < 0; }
+
+/* copies and indexes count points, sorting bands on up to threads threads */
+void exactOracle::build(const Point *points, size_t count, unsigned threads)
+{
+	/* sorted by rank as one slice per thread, then slices merged pairwise */
+	m_points.assign(points, points + count);
+	size_t slices = (threads > 1) ? threads : 1;
+	auto sliceStart = [&](size_t slice) { return m_points.begin() + (ptrdiff_t)(count * std::min(slice, slices) / slices); };
+	run_parts(threads, slices, [&](size_t slice) { std::sort(sliceStart(slice), sliceStart(slice + 1), rankLess); });
+	for (size_t width = 1; width < slices; width *= 2)
+		run_parts(threads, (slices + 2 * width - 1) / (2 * width), [&](size_t pair) {
+			size_t first = pair * 2 * width;
+			std::inplace_merge(sliceStart(first), sliceStart(first + width), sliceStart(first + 2 * width), rankLess);
+		});
+
+	/* bands of consecutive ranks, doubling in size */
+	m_bandStart.clear();
+	for (size_t start = 0, size = ORACLE_FIRST_BAND; start < count; start += size, size = std::min(size * 2, (size_t)ORACLE_LAST_BAND))
+		m_bandStart.push_back(start);
+	m_bandStart.push_back(count);
+
+	m_ys.resize(count);
+	m_yOrder.resize(count);
+	run_parts(threads, m_bandStart.size() - 1, [&](size_t band) {
+		size_t begin = m_bandStart[band], end = m_bandStart[band + 1];
+		std::sort(m_points.begin() + begin, m_points.begin() + end, xLess);
+		for (size_t i = begin; i < end; i++) m_yOrder[i] = (uint32_t)(i - begin);
+		std::sort(m_yOrder.begin() + begin, m_yOrder.begin() + end, [&](uint32_t a, uint32_t b) {
+			return m_points[begin + a].y < m_points[begin + b].y;
+		});
+		for (size_t i = begin; i < end; i++) m_ys[i] = m_points[begin + m_yOrder[i]].y;
+	});
+}
+
+/* same contract as search() export */
+int32_t exactOracle::search(const Rect &rect, const int32_t count, Point *out_points) const
+{
+	/* inverted or NaN bounds match nothing, no need to read every band to find that out */
+	int32_t matches = 0;
+	if (!(rect.lx <= rect.hx) || !(rect.ly <= rect.hy)) return 0;
+	std::vector<Point> found;
+	for (size_t band = 0; (band + 1 < m_bandStart.size()) && (matches < count); band++)
+	{
+		/* every match of the band lies in both the slab with x in [lx,hx] and the one with y in [ly,hy] */
+		const Point *points = m_points.data() + m_bandStart[band];
+		const Point *xBegin = std::lower_bound(points, m_points.data() + m_bandStart[band + 1], rect.lx, xBelow);
+		const Point *xEnd = std::upper_bound(xBegin, m_points.data() + m_bandStart[band + 1], rect.hx, xAbove);
+		const float *ys = m_ys.data() + m_bandStart[band];
+		const float *yBegin = std::lower_bound(ys, m_ys.data() + m_bandStart[band + 1], rect.ly);
+		const float *yEnd = std::upper_bound(yBegin, m_ys.data() + m_bandStart[band + 1], rect.hy);
+
+		/* so only the narrower one is read */
+		found.clear();
+		if (xEnd - xBegin <= yEnd - yBegin)
+		{
+			for (const Point *p = xBegin; p < xEnd; ++p)
+				if ((p->y >= rect.ly) && (p->y <= rect.hy)) found.push_back(*p);
+		}
+		else
+		{
+			const uint32_t *order = m_yOrder.data() + m_bandStart[band];
+			for (const float *y = yBegin; y < yEnd; ++y)
+			{
+				const Point &p = points[order[y - ys]];
+				if ((p.x >= rect.lx) && (p.x <= rect.hx)) found.push_back(p);
+			}
+		}
+
+		/* lowest ranked of them follow the matches of earlier bands */
+		size_t take = std::min(found.size(), (size_t)(count - matches));
+		std::partial_sort(found.begin(), found.begin() + take, found.end(), rankLess);
+		for (size_t i = 0; i < take; i++) out_points[matches++] = found[i];
+	}
+	return matches;
+}
+
+/* sets hashes[i] to resultHash() of the exact results of rects[i] for i in [0,n), searching on up to threads threads */
+void exactOracle::expect(const Rect *rects, size_t n, int32_t count, unsigned threads, std::vector<uint64_t> &hashes) const
+{
+	hashes.assign(n, 0);
+	size_t chunks = (n + ORACLE_QUERY_CHUNK - 1) / ORACLE_QUERY_CHUNK;
+	run_parts(threads, chunks, [&](size_t chunk) {
+		std::vector<Point> out((count > 0) ? count : 0);
+		for (size_t i = chunk * ORACLE_QUERY_CHUNK; (i < n) && (i < (chunk + 1) * ORACLE_QUERY_CHUNK); i++)
+		{
+			int32_t found = (count > 0) ? search(rects[i], count, out.data()) : 0;
+			hashes[i] = resultHash(out.data(), found);
+		}
+	});
+}
+
+/* release memory */
+void exactOracle::clear(void)
+{
+	std::vector<Point>().swap(m_points);
+	std::vector<float>().swap(m_ys);
+	std::vector<uint32_t>().swap(m_yOrder);
+	std::vector<size_t>().swap(m_bandStart);
+}
+
+/* FNV-1a over the bytes of the count and then of each Point, runs of equal rank in byte order */
+uint64_t resultHash(const Point *points, int32_t count)
+{
+	if (count < 0) count = 0;
+	uint64_t hash = 14695981039346656037ull;
+	const unsigned char *bytes = (const unsigned char *)&count;
+	for (size_t b = 0; b < sizeof(count); b++) hash = (hash ^ bytes[b]) * 1099511628211ull;
+
+	std::vector<Point> ties;
+	for (int32_t i = 0; i < count; )
+	{
+		/* a run of Points sharing a rank, almost always just one */
+		int32_t end = i + 1;
+		while ((end < count) && (points[end].rank == points[i].rank)) end++;
+		const Point *run = points + i;
+		if (end - i > 1)
+		{
+			ties.assign(points + i, points + end);
+			std::sort(ties.begin(), ties.end(), bytesLess);
+			run = ties.data();
+		}
+		for (int32_t j = 0; j < end - i; j++)
+		{
+			bytes = (const unsigned char *)&run[j];
+			for (size_t b = 0; b < sizeof(Point); b++) hash = (hash ^ bytes[b]) * 1099511628211ull;
+		}
+		i = end;
+	}
+	return hash;
+}
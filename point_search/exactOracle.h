@@ -0,0 +1,47 @@
+#pragma once
+#ifndef __EXACT_ORACLE__
+#define __EXACT_ORACLE__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "point_search.h"
+
+/* Points in the first (lowest ranked) band of the oracle, each following band doubles up to the last size */
+#define ORACLE_FIRST_BAND 1024
+#define ORACLE_LAST_BAND 65536
+
+/* Reference answers the plugins are checked against, simple enough to be trusted yet fast enough for 10M points
+   and 100K queries.  Points are sorted by rank and cut into bands of consecutive ranks, each band then sorted by
+   x with a y sorted index beside it.  A search visits bands in rank order, binary searches the band for rect's x
+   and y ranges, tests the Points of the narrower slab against the other axis and keeps the lowest ranked matches,
+   stopping after the first band that completes count matches as every later band ranks higher.  Bands start
+   small so wide rects finish after reading a few Points, and thin rects (even lines) only read a thin slab. */
+class exactOracle
+{
+public:
+	/* copies and indexes count points, sorting bands on up to threads threads */
+	void build(const Point *points, size_t count, unsigned threads);
+
+	/* same contract as search() export */
+	int32_t search(const Rect &rect, const int32_t count, Point *out_points) const;
+
+	/* sets hashes[i] to resultHash() of the exact results of rects[i] for i in [0,n), searching on up to threads threads */
+	void expect(const Rect *rects, size_t n, int32_t count, unsigned threads, std::vector<uint64_t> &hashes) const;
+
+	/* release memory */
+	void clear(void);
+
+private:
+	std::vector<Point> m_points;      /* bands in rank order, each sorted by x             */
+	std::vector<float> m_ys;          /* y of each band's Points in y order                */
+	std::vector<uint32_t> m_yOrder;   /* position within its band of the Point of each y   */
+	std::vector<size_t> m_bandStart;  /* first Point of each band, plus end                */
+};
+
+/* hash of count result Points (a negative count hashes as none) in their order, except that Points of equal rank
+   are hashed in a fixed order of their bytes, so plugins returning the same Points agree regardless of how they
+   order ties */
+uint64_t resultHash(const Point *points, int32_t count);
+
+#endif /* __EXACT_ORACLE__ */
@@ -0,0 +1,95 @@
+#include "latencyHistogram.h"
+#ifdef _MSC_VER
+#include <intrin.h>  /* for _BitScanReverse64 */
+#endif
+
+/* values with their highest bit at or below this many bits are counted exactly */
+static const uint64_t EXACT_VALUES = 1ull << HISTOGRAM_SUB_BITS;
+/* linear buckets per power of two above them */
+static const uint64_t HALF_BUCKETS = EXACT_VALUES / 2;
+/* exact buckets plus linear ones for every larger power of two up to 2^63 */
+static const size_t BUCKETS = (size_t)(EXACT_VALUES + (64 - HISTOGRAM_SUB_BITS) * HALF_BUCKETS);
+
+/* position of highest one bit in value, value must not be 0 */
+static inline unsigned highestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (unsigned)index;
+#else
+	return 63u - (unsigned)__builtin_clzll(value);
+#endif
+}
+
+latencyHistogram::latencyHistogram(void)
+{
+	reset();
+}
+
+/* forget all recorded latencies */
+void latencyHistogram::reset(void)
+{
+	m_buckets.assign(BUCKETS, 0);
+	m_count = 0;
+	m_min = UINT64_MAX;
+	m_max = 0;
+	m_sum = 0.0;
+}
+
+/* bucket counting value: exact below EXACT_VALUES, else the top HISTOGRAM_SUB_BITS bits select it */
+size_t latencyHistogram::bucketOf(uint64_t value)
+{
+	if (value < EXACT_VALUES) return (size_t)value;
+	unsigned shift = highestBit(value) - (HISTOGRAM_SUB_BITS - 1);
+	return (size_t)(EXACT_VALUES + (shift - 1) * HALF_BUCKETS + ((value >> shift) - HALF_BUCKETS));
+}
+
+/* highest value counted by bucket */
+uint64_t latencyHistogram::highestIn(size_t bucket)
+{
+	if (bucket < EXACT_VALUES) return bucket;
+	uint64_t shift = (bucket - EXACT_VALUES) / HALF_BUCKETS + 1;
+	uint64_t sub = (bucket - EXACT_VALUES) % HALF_BUCKETS + HALF_BUCKETS;
+	return ((sub + 1) << shift) - 1;
+}
+
+/* count one latency of ns nanoseconds */
+void latencyHistogram::record(uint64_t ns)
+{
+	m_buckets[bucketOf(ns)]++;
+	m_count++;
+	m_sum += (double)ns;
+	if (ns < m_min) m_min = ns;
+	if (ns > m_max) m_max = ns;
+}
+
+/* mean of recorded latencies, exact, 0 if none */
+double latencyHistogram::mean(void) const
+{
+	return m_count ? m_sum / m_count : 0.0;
+}
+
+/* latency at or below which percent of the recorded latencies fall, 0 if none */
+uint64_t latencyHistogram::percentile(double percent) const
+{
+	if (m_count == 0) return 0;
+	/* rank of the latency wanted, at least the first and at most the last */
+	double wanted = percent / 100.0 * m_count;
+	uint64_t rank = (uint64_t)wanted;
+	if ((double)rank < wanted) rank++;
+	if (rank < 1) rank = 1;
+	if (rank > m_count) rank = m_count;
+
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < m_buckets.size(); bucket++)
+	{
+		seen += m_buckets[bucket];
+		if (seen >= rank)
+		{
+			uint64_t value = highestIn(bucket);
+			return (value < m_max) ? value : m_max;
+		}
+	}
+	return m_max;
+}
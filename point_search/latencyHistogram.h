@@ -0,0 +1,52 @@
+#pragma once
+#ifndef __LATENCY_HISTOGRAM__
+#define __LATENCY_HISTOGRAM__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/* bits of sub-bucket within each power of two, recorded values are kept to within 1/64 of their size */
+#define HISTOGRAM_SUB_BITS 7
+
+/* HDR style histogram of latencies in nanoseconds.  Values below 2^HISTOGRAM_SUB_BITS are counted exactly,
+   each larger power of two is split into 2^(HISTOGRAM_SUB_BITS-1) linear buckets, so any value up to 2^64
+   fits in a few thousand counters with constant relative error, and recording is a shift and an increment. */
+class latencyHistogram
+{
+public:
+	latencyHistogram(void);
+
+	/* count one latency of ns nanoseconds */
+	void record(uint64_t ns);
+
+	/* forget all recorded latencies */
+	void reset(void);
+
+	/* number of latencies recorded */
+	uint64_t count(void) const { return m_count; }
+
+	/* mean of recorded latencies, exact, 0 if none */
+	double mean(void) const;
+
+	/* largest and smallest recorded latency, exact, 0 if none (not max and min, which Windows.h defines as macros) */
+	uint64_t highest(void) const { return m_max; }
+	uint64_t lowest(void) const { return m_count ? m_min : 0; }
+
+	/* latency at or below which percent (0-100) of the recorded latencies fall, as the highest value of its
+	   bucket (never above max), 0 if none */
+	uint64_t percentile(double percent) const;
+
+private:
+	/* bucket counting value, and highest value counted by bucket */
+	static size_t bucketOf(uint64_t value);
+	static uint64_t highestIn(size_t bucket);
+
+	std::vector<uint64_t> m_buckets;
+	uint64_t m_count;
+	uint64_t m_min;
+	uint64_t m_max;
+	double m_sum;
+};
+
+#endif /* __LATENCY_HISTOGRAM__ */
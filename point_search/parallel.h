@@ -0,0 +1,32 @@
+#pragma once
+#ifndef __PS_PARALLEL__
+#define __PS_PARALLEL__
+
+#include <stddef.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+/* number of hardware threads, at least 1 */
+inline unsigned hardware_threads(void)
+{
+	unsigned threads = std::thread::hardware_concurrency();
+	return (threads > 0) ? threads : 1;
+}
+
+/* runs task(part) for every part in [0,parts) on up to threads threads, the calling thread being one of them,
+   parts taken one at a time so uneven parts balance out */
+template <typename Task>
+void run_parts(unsigned threads, size_t parts, const Task &task)
+{
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t part; (part = next++) < parts; ) task(part);
+	};
+	std::vector<std::thread> pool;
+	for (unsigned t = 1; (t < threads) && (t < parts); t++) pool.push_back(std::thread(worker));
+	worker();
+	for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+}
+
+#endif /* __PS_PARALLEL__ */
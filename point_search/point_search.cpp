@@ -1,14 +1,20 @@
 #include <queue>
-#include <random>
 #include <stdio.h>
+#include <string.h>
 #include <string>
 #include <tchar.h>
+#include <thread>
 #include <vector>
 #include <Windows.h>
 
 #include "point_search.h"
 #include "processInfo.h"
 #include "timer.h"
+#include "latencyHistogram.h"
+#include "exactOracle.h"
+#include "counterRandom.h"
+#include "parallel.h"
+#include "dataFile.h"
 
 /* seed our random number generator - see https://msdn.microsoft.com/en-us/library/aa387694.aspx */
 #define SystemFunction036 NTAPI SystemFunction036
@@ -26,6 +32,7 @@ struct PointFunctions {
 	T_create create;
 	T_search search;
 	T_destroy destroy;
+	T_search_batch search_batch;  /* optional, NULL if not exported */
 };
 
 /* challenger plugin specific information */
@@ -33,54 +40,115 @@ struct Challenger {
 	tstring name;        /* filename with path, & displayed identity */
 	HMODULE handle;      /* handle to plugin (DLL) after loaded      */
 	PointFunctions fns;  /* functions we import from plugin          */
-	/* stored results for comparisons                                */
-	Point * results;
+	/* queries whose results differ from the exact ones, the first   */
+	int32_t mismatches;
+	int32_t firstMismatch;
+	bool checked;        /* completed its queries, so was compared   */
 	/* and stored process state for usage information                */
 	processInfo pi;
+
+	Challenger() {
+		handle = NULL;
+		mismatches = 0;
+		firstMismatch = -1;
+		checked = false;
+	}
 };
 
 /* normally runtime is positive, so flag a crash as negative time */
 const double CRASHED_TIME = -1.0;
 
+/* per query latency statistic the scoreboard is ranked by */
+enum ScoreMetric {
+	SCORE_MEAN,  /* mean latency, ranks as total search time did */
+	SCORE_P99,   /* 99th percentile latency                      */
+	SCORE_MAX    /* worst latency of any query                   */
+};
+
 /* stores results information about a challengers runs */
 struct ChallengerResults {
 	double searchTime;     /* how long challenger took to run search */
+	double batchTime;      /* how long search_batch took for all queries, CRASHED_TIME if not exported */
+	/* per query latencies in microseconds */
+	double meanLatency;
+	double p50Latency;
+	double p90Latency;
+	double p99Latency;
+	double p999Latency;
+	double maxLatency;
 	struct Challenger *challenger;
 
 	ChallengerResults(Challenger *pChallenger) {
-		searchTime = CRASHED_TIME;
+		searchTime = batchTime = CRASHED_TIME;
+		meanLatency = p50Latency = p90Latency = p99Latency = p999Latency = maxLatency = CRASHED_TIME;
 		challenger = pChallenger;
 	}
+
+	/* value of metric for these results */
+	double score(ScoreMetric metric) const {
+		if (metric == SCORE_P99) return p99Latency;
+		if (metric == SCORE_MAX) return maxLatency;
+		return meanLatency;
+	}
 };
 
-/* challenger results ranked for priority queue */
+/* short name of metric, also the value accepted by -m */
+const char *score_metric_name(ScoreMetric metric)
+{
+	if (metric == SCORE_P99) return "p99";
+	if (metric == SCORE_MAX) return "max";
+	return "mean";
+}
+
+/* challenger results ranked for priority queue by selected metric */
 class RankChallengerResults {
 public:
+	RankChallengerResults(ScoreMetric m = SCORE_MEAN) : metric(m) {}
+
     bool operator()(ChallengerResults& c1, ChallengerResults& c2)
     {
-		/* Note: if challenger crashed then will appear to be winner due to negative time */
-		if (c1.searchTime > c2.searchTime) return true;
+		/* Note: only challengers that completed with exact results are ranked */
+		if (c1.score(metric) > c2.score(metric)) return true;
 		return false;
     }
+
+private:
+	ScoreMetric metric;
 };
 
 typedef std::priority_queue<ChallengerResults, std::vector<ChallengerResults>, RankChallengerResults> Rankings;
 
 /* challenge specific setup */
 struct ChallengeOptions {
-	int32_t pointCount;
+	int64_t pointCount;
 	int32_t queryCount;
 	int32_t resultCount;
+	int32_t stressThreads;
+	ScoreMetric metric;
 	int32_t randomSeed[4];
+	tstring saveDataPath;  /* --save-data, empty if not saving  */
+	tstring loadDataPath;  /* --load-data, empty if generating */
 	std::vector<Challenger> plugins;
-	std::vector<Point> points;
-	std::vector<Rect> queryRects;
+	/* pointCount points and queryCount rects, either generated into the vectors or viewed in the mapped data file */
+	const Point *points;
+	const Rect *queryRects;
+	std::vector<Point> generatedPoints;
+	std::vector<Rect> generatedRects;
+	dataFile data;
+	std::vector<uint64_t> expectedHashes;  /* resultHash() of exact results of each query rect */
 };
 
+/* independent streams of the seed */
+enum RandomStream {
+	STREAM_POINTS,       /* id, x and y of each point       */
+	STREAM_RANKS,        /* permutation giving unique ranks */
+	STREAM_QUERY_RECTS   /* bounds of each query rect       */
+};
 
-std::default_random_engine generator;
-std::uniform_real_distribution<double> rdistribution(-0.5, 0.5);
-std::uniform_int_distribution<int32_t> idistribution(INT_MIN/2,INT_MAX/2);
+/* scale of random coordinates, float only has FLT_DIG=6 digits of precision */
+const double COORDINATE_SCALE = 99997.7;
+/* ranks of generated points are a permutation of their 31 bit indices, so no more can be generated with unique ranks */
+const int64_t MAX_GENERATED_POINTS = (int64_t)1 << 31;
 
 
 /* displays welcome/description banner to user */
@@ -95,22 +163,30 @@ void initialize_default_options(ChallengeOptions &options)
 	options.pointCount = 10000000;
 	options.queryCount = 1000;
 	options.resultCount = 20;
+	options.stressThreads = 0;
+	options.metric = SCORE_MEAN;
 
 	RtlGenRandom(options.randomSeed, 16);
-	std::seed_seq seed(&options.randomSeed[0],&options.randomSeed[3]);
-	generator.seed(seed);
 
+	options.saveDataPath.clear();
+	options.loadDataPath.clear();
 	options.plugins.clear();
-	options.points.clear();
-	options.queryRects.clear();
+	options.points = NULL;
+	options.queryRects = NULL;
+	options.generatedPoints.clear();
+	options.generatedRects.clear();
+	options.data.close();
 }
 
 /* displays current option values */
 void print_options(ChallengeOptions &options)
 {
-	printf("Point count  : %u\n", options.pointCount);
+	if (!options.loadDataPath.empty()) _tprintf(_T("Data file    : %s\n"), options.loadDataPath.c_str());
+	printf("Point count  : %llu\n", (unsigned long long)options.pointCount);
 	printf("Query count  : %u\n", options.queryCount);
 	printf("Result count : %u\n", options.resultCount);
+	if (options.stressThreads > 0) printf("Stress threads: %u\n", options.stressThreads);
+	printf("Ranked by   : %s latency\n", score_metric_name(options.metric));
 	printf("Random seed  : %08X-%08X-%08X-%08X\n", options.randomSeed[0], options.randomSeed[1], options.randomSeed[2], options.randomSeed[3]);
 	printf("\n");
 }
@@ -124,16 +200,24 @@ void print_help_message(ChallengeOptions &options)
 		"You can specify a list of plugins that solve this problem, and their \n"
 		"results and performance will be compared!\n"
 		"Usage:\n"
-		"        point_search.exe plugin_paths [-pN] [-qN] [-rN] [-s]\n"
+		"        point_search.exe plugin_paths [-pN] [-qN] [-rN] [-s] [-tN] [-mX]\n"
+		"                         [--save-data path] [--load-data path]\n"
 		"Options:\n"
-		"        -pN: point count (default: %u)\n"
+		"        -pN: point count, at most 2^31 (default: %llu)\n"
 		"        -qN: query count (default: %u)\n"
 		"        -rN: result count (default: %u)\n"
-		"        -sX: specify seed (default: random)\n"
+		"        -sX: specify seed as printed, to repeat a run (default: random)\n"
+		"        -tN: also run queries from 1, 2, 4 ... N threads sharing one context\n"
+		"             and report aggregate queries per second (default: off)\n"
+		"        -mX: rank scoreboard by mean, p99 or max query latency (default: mean)\n"
+		"        --save-data path: write the points and query rects to a data file,\n"
+		"             no plugins are needed just to write one\n"
+		"        --load-data path: map points, query rects and seed from a data file\n"
+		"             instead of generating them, -p, -q and -s are then ignored\n"
 		"Example:\n"
 		"        point_search.exe reference.dll coyote.dll -p10000000 -q100000 -r20 \n"
 		"                         -s%08X-%08X-%08X-%08X\n",
-		options.pointCount, options.queryCount, options.resultCount,
+		(unsigned long long)options.pointCount, options.queryCount, options.resultCount,
 		options.randomSeed[0], options.randomSeed[1], options.randomSeed[2], options.randomSeed[3]
 	);
 
@@ -153,7 +237,7 @@ void process_command_line_arguments(int argc, TCHAR *argv[], ChallengeOptions &o
 			switch(tolower(argv[i][1])) 
 			{
 				case 'p': {
-					options.pointCount = _ttoi(argv[i]+2);
+					options.pointCount = _ttoi64(argv[i]+2);
 					break;
 				}
 				case 'q': {
@@ -164,8 +248,39 @@ void process_command_line_arguments(int argc, TCHAR *argv[], ChallengeOptions &o
 					options.resultCount = _ttoi(argv[i]+2);
 					break;
 				}
+				case 't': {
+					options.stressThreads = _ttoi(argv[i]+2);
+					break;
+				}
+				case 'm': {
+					if (_tcsicmp(argv[i]+2, _T("p99")) == 0) options.metric = SCORE_P99;
+					else if (_tcsicmp(argv[i]+2, _T("max")) == 0) options.metric = SCORE_MAX;
+					else options.metric = SCORE_MEAN;
+					break;
+				}
 				case 's': {
-					printf("\n-s option not yet supported.  Sorry.\n\n");
+					/* up to 4 hex words separated by '-', any missing are 0 */
+					TCHAR *word = argv[i]+2;
+					for (int w = 0; w < 4; w++) {
+						TCHAR *end;
+						options.randomSeed[w] = (int32_t)_tcstoul(word, &end, 16);
+						word = (*end == '-') ? end+1 : end;
+					}
+					break;
+				}
+				case '-': {
+					/* long options, their value follows '=' or is the next argument */
+					tstring name(argv[i]+2), value;
+					size_t equals = name.find('=');
+					bool known = (name.compare(0, equals, _T("save-data")) == 0) || (name.compare(0, equals, _T("load-data")) == 0);
+					if (equals != tstring::npos) {
+						value = name.substr(equals+1);
+						name.resize(equals);
+					} else if (known && (i+1 < argc)) {
+						value = argv[++i];
+					}
+					if (name == _T("save-data")) options.saveDataPath = value;
+					else if (name == _T("load-data")) options.loadDataPath = value;
 					break;
 				}
 				default: {
@@ -199,6 +314,7 @@ bool load_plugin(Challenger &plugin)
 		plugin.fns.create = (T_create)GetProcAddress(h, "create");
 		plugin.fns.search = (T_search)GetProcAddress(h, "search");
 		plugin.fns.destroy = (T_destroy)GetProcAddress(h, "destroy");
+		plugin.fns.search_batch = (T_search_batch)GetProcAddress(h, "search_batch");
 		if (plugin.fns.create == NULL || plugin.fns.search == NULL || plugin.fns.destroy == NULL) {
 			printf("Not a valid module.\n");
 			return true;
@@ -234,66 +350,122 @@ void load_all_plugins(ChallengeOptions &options)
 }
 
 
-/* returns random float between -INT_MAX/2 and INT_MAX/2 */
-inline float frand(void)
+/* key of the stream of options' seed, all 128 bits of the seed select it */
+uint64_t seed_stream_key(ChallengeOptions &options, RandomStream stream)
 {
-	register float f = static_cast<float>(rdistribution(generator) * 99997.7);  // float only has FLT_DIG=6 digits of precision
-	//printf("%+13.6f\n", (double)f);
-	return f;
+	uint64_t high = ((uint64_t)(uint32_t)options.randomSeed[0] << 32) | (uint32_t)options.randomSeed[1];
+	uint64_t low = ((uint64_t)(uint32_t)options.randomSeed[2] << 32) | (uint32_t)options.randomSeed[3];
+	return stream_key(high ^ mix64(low), stream);
 }
 
-
-/* create list of random points to search */
-void generate_random_points(size_t count, std::vector<Point> &points)
+/* create list of random points to search, each point depends only on the seed and its index so any *
+ * number of threads make the same points, ranks are a keyed permutation of indices so never repeat */
+void generate_random_points(ChallengeOptions &options, unsigned threads)
 {
 	ps_timer timer;
-	printf("Preparing %d random points...", count);
-
-	/* ensure empty and enough space for all our generated points */
-	points.clear();
-	points.reserve(count);
-
-	/* create count points */
-	for (size_t i=0; i < count; i++)
-	{
-		Point point;
-		point.id = idistribution(generator) % 256;
-		point.rank = idistribution(generator);
-		point.x = frand();
-		point.y = frand();
-		points.push_back(point);
-	}
+	size_t count = (size_t)options.pointCount;
+	printf("Preparing %llu random points...", (unsigned long long)count);
+
+	/* exactly enough space for all our generated points, each thread fills its own slices */
+	options.generatedPoints.clear();
+	options.generatedPoints.resize(count);
+	Point *points = options.generatedPoints.data();
+	options.points = points;
+	uint64_t pointKey = seed_stream_key(options, STREAM_POINTS), rankKey = seed_stream_key(options, STREAM_RANKS);
+	const size_t slice = 1 << 16;
+	run_parts(threads, (count + slice - 1) / slice, [&](size_t part) {
+		for (size_t i = part * slice; (i < count) && (i < (part + 1) * slice); i++)
+		{
+			uint64_t rx = counter_random(pointKey, 2 * i), ry = counter_random(pointKey, 2 * i + 1);
+			points[i].id = (int8_t)(rx & 0xFF);
+			/* unique ranks in [INT_MIN/2, INT_MAX/2] */
+			points[i].rank = INT_MIN/2 + (int32_t)permute31((uint32_t)i, rankKey);
+			points[i].x = static_cast<float>(centered_unit(rx) * COORDINATE_SCALE);
+			points[i].y = static_cast<float>(centered_unit(ry) * COORDINATE_SCALE);
+		}
+	});
 	printf("done (%.4fms).\n", timer.elapsed());
 }
 
 
-/* create list of query rectangles for searches */
-void generate_random_query_rects(size_t count, std::vector<Rect> &queryRects)
+/* create list of query rectangles for searches, from their own stream of the seed */
+void generate_random_query_rects(ChallengeOptions &options)
 {
 	ps_timer timer;
+	size_t count = options.queryCount;
 	printf("Preparing %d random queries...", count);
 
-	/* ensure empty and enough space for all our generated points */
-	queryRects.clear();
-	queryRects.reserve(count);
+	/* ensure empty and enough space for all our generated rects */
+	options.generatedRects.clear();
+	options.generatedRects.reserve(count);
+	uint64_t key = seed_stream_key(options, STREAM_QUERY_RECTS);
 
-	/* create count points */
+	/* create count rects */
 	for (size_t i=0; i < count; i++)
 	{
 		Rect rect;
-		rect.lx = frand();
-		rect.hx = frand();
-		rect.ly = frand();
-		rect.hy = frand();
+		rect.lx = static_cast<float>(centered_unit(counter_random(key, 4 * i)) * COORDINATE_SCALE);
+		rect.hx = static_cast<float>(centered_unit(counter_random(key, 4 * i + 1)) * COORDINATE_SCALE);
+		rect.ly = static_cast<float>(centered_unit(counter_random(key, 4 * i + 2)) * COORDINATE_SCALE);
+		rect.hy = static_cast<float>(centered_unit(counter_random(key, 4 * i + 3)) * COORDINATE_SCALE);
 		/* ensure low and high values are in correct members */
 		if (rect.hx < rect.lx) { float tx = rect.hx; rect.hx = rect.lx; rect.lx = tx; }
-		if (rect.hy < rect.ly) { float ty = rect.hy; rect.hy = rect.ly; rect.lx = ty; }
-		queryRects.push_back(rect);
+		if (rect.hy < rect.ly) { float ty = rect.hy; rect.hy = rect.ly; rect.ly = ty; }
+		options.generatedRects.push_back(rect);
+	}
+	options.queryRects = options.generatedRects.data();
+	printf("done (%.4fms).\n", timer.elapsed());
+}
+
+
+/* maps the points, query rects and seed of the --load-data file in place of generating them, *
+ * returns true if any errors/failures                                                       */
+bool load_data_file(ChallengeOptions &options)
+{
+	ps_timer timer;
+	_tprintf(_T("Mapping data file %s..."), options.loadDataPath.c_str());
+	/* rect counts are passed to plugins as int32_t */
+	if (!options.data.open(options.loadDataPath.c_str()) || (options.data.queryCount() > INT32_MAX)) {
+		printf("not a usable data file.\n");
+		return true;
+	}
+	options.points = options.data.points();
+	options.pointCount = (int64_t)options.data.pointCount();
+	options.queryRects = options.data.rects();
+	options.queryCount = (int32_t)options.data.queryCount();
+	memcpy(options.randomSeed, options.data.randomSeed(), sizeof(options.randomSeed));
+	printf("done (%.4fms).\n", timer.elapsed());
+	return false;
+}
+
+/* writes the points and query rects to the --save-data file, so the run can be repeated from it */
+void save_data_file(ChallengeOptions &options)
+{
+	ps_timer timer;
+	_tprintf(_T("Saving data file %s..."), options.saveDataPath.c_str());
+	if (!dataFile::write(options.saveDataPath.c_str(), options.points, (uint64_t)options.pointCount, options.queryRects,
+		(uint64_t)options.queryCount, options.randomSeed)) {
+		printf("FAILED!\n");
+		return;
 	}
 	printf("done (%.4fms).\n", timer.elapsed());
 }
 
 
+/* hash the exact results of every query rect with the built in oracle, on all hardware threads, *
+ * so plugins can be checked as they search without storing their results                      */
+void prepare_expected_results(ChallengeOptions &options)
+{
+	ps_timer timer;
+	printf("Preparing exact results...");
+	unsigned threads = hardware_threads();
+	exactOracle oracle;
+	oracle.build(options.points, (size_t)options.pointCount, threads);
+	oracle.expect(options.queryRects, options.queryCount, options.resultCount, threads, options.expectedHashes);
+	printf("done (%.4fms).\n", timer.elapsed());
+}
+
+
 /* verify some basic funtionality of plugin *
  * returns true if any errors/failures      */
 bool plugin_ruggedness_check(Challenger &plugin, ChallengeOptions &options)
@@ -301,8 +473,9 @@ bool plugin_ruggedness_check(Challenger &plugin, ChallengeOptions &options)
 	try {
 		/* attempt running with no points */
 		printf("Ruggedness check...");
+		Rect rect = (options.queryCount > 0) ? options.queryRects[0] : Rect();
 		SearchContext *sc = plugin.fns.create(NULL, NULL);
-		plugin.fns.search(sc, options.queryRects[0], options.resultCount, NULL);
+		plugin.fns.search(sc, rect, options.resultCount, NULL);
 		plugin.fns.destroy(sc);
 	} catch(std::exception e) {
 		printf("CRASHED!\n");
@@ -312,14 +485,14 @@ bool plugin_ruggedness_check(Challenger &plugin, ChallengeOptions &options)
 	return false;
 }
 
-/* pass a copy of random points to plugin *
- * returns true if any errors/failures    */
+/* pass the points to plugin, a view into the mapping if loaded from a data file *
+ * returns true if any errors/failures                                          */
 bool plugin_load_points(Challenger &plugin, SearchContextPtr &sc, ChallengeOptions &options)
 {
 	ps_timer timer;
 	try {
 		printf("Loading points...");
-		sc = plugin.fns.create(options.points.data(), options.points.data()+options.pointCount);
+		sc = plugin.fns.create(options.points, options.points+options.pointCount);
 	} catch(std::exception e) {
 		printf("CRASHED!\n");
 		return true;
@@ -328,34 +501,129 @@ bool plugin_load_points(Challenger &plugin, SearchContextPtr &sc, ChallengeOptio
 	return false;
 }
 
+/* compare the n Points found for query index with the exact results */
+bool results_match(ChallengeOptions &options, int32_t index, const Point *found, int32_t n)
+{
+	/* a count outside the caller's buffer is wrong whatever the Points */
+	return (n >= 0) && (n <= options.resultCount) && (resultHash(found, n) == options.expectedHashes[index]);
+}
+
 /* do the queries                         *
  * returns ChallengerResults              */
 ChallengerResults plugin_make_queries(Challenger &plugin, SearchContextPtr &sc, ChallengeOptions &options)
 {
 	ps_timer timer(false);
 	ChallengerResults cResults(&plugin);;
+	latencyHistogram latency;
 
 	try {
+		/* every plugin is timed rect by rect through search, a batch gives no query's results before it
+		   returns, so its per query latency and the scoreboard rank come from these calls as for any other */
 		printf("Making queries...");
-		int32_t index = 0;
-		for (auto query = options.queryRects[index]; index < options.queryCount; ++index)
+		std::vector<Point> found(options.resultCount);
+		std::vector<char> matched(options.queryCount);
+		for (int32_t index = 0; index < options.queryCount; ++index)
 		{
-			/* let challenger run the search and store found points */
+			/* let challenger run the search, then check the points found */
 			timer.start();
-			plugin.fns.search(sc, query, options.resultCount, plugin.results+(index * options.resultCount));
+			int32_t n = plugin.fns.search(sc, options.queryRects[index], options.resultCount, found.data());
 			timer.stop();
+			latency.record(timer.lastNanoseconds());
+			matched[index] = results_match(options, index, found.data(), n);
 		}
+		cResults.searchTime = timer.elapsed();
+		printf("done (%.4fms, avg %.4fms/query).\n", cResults.searchTime, cResults.searchTime/options.queryCount);
+
+		if (plugin.fns.search_batch != NULL) {
+			/* plugin answers all query rects in a single call, whose results are checked as well; it only runs once
+			   the timed calls are done, so whatever it leaves cached in the plugin cannot speed those up, and its own
+			   time (which may gain from theirs) is only reported, never ranked */
+			printf("Making queries (batch)...");
+			std::vector<int32_t> counts(options.queryCount);
+			std::vector<Point> batchFound((size_t)options.queryCount * options.resultCount);
+			ps_timer batchTimer(false);
+			batchTimer.start();
+			plugin.fns.search_batch(sc, options.queryRects, options.queryCount, options.resultCount, batchFound.data(), counts.data());
+			batchTimer.stop();
+			cResults.batchTime = batchTimer.elapsed();
+			for (int32_t index = 0; index < options.queryCount; ++index)
+				if (!results_match(options, index, batchFound.data() + (size_t)index * options.resultCount, counts[index])) matched[index] = 0;
+			printf("done (%.4fms, avg %.4fms/query).\n", cResults.batchTime, cResults.batchTime/options.queryCount);
+		}
+
+		for (int32_t index = 0; index < options.queryCount; ++index)
+			if (!matched[index] && (plugin.mismatches++ == 0)) plugin.firstMismatch = index;
+		plugin.checked = true;
 	} catch(std::exception e) {
 		printf("CRASHED!\n");
 		cResults.searchTime = CRASHED_TIME;
 		return cResults;
 	}
 
-	cResults.searchTime = timer.elapsed();
-	printf("done (%.4fms, avg %.4fms/query).\n", cResults.searchTime, cResults.searchTime/options.queryCount);
+	/* mean spreads total time over queries, percentiles come from each query's own latency */
+	cResults.meanLatency = (options.queryCount > 0) ? 1000.0 * cResults.searchTime / options.queryCount : 0.0;
+	cResults.p50Latency = latency.percentile(50.0) / 1000.0;
+	cResults.p90Latency = latency.percentile(90.0) / 1000.0;
+	cResults.p99Latency = latency.percentile(99.0) / 1000.0;
+	cResults.p999Latency = latency.percentile(99.9) / 1000.0;
+	cResults.maxLatency = latency.highest() / 1000.0;
+	printf("Latency (us): mean %.2f, p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f\n", cResults.meanLatency,
+		cResults.p50Latency, cResults.p90Latency, cResults.p99Latency, cResults.p999Latency, cResults.maxLatency);
 	return cResults;
 }
 
+/* every thread runs all queries against the shared context, starting at its own offset so threads are
+ * not in lockstep on the same rect, results are discarded                                            */
+static void stress_queries(Challenger *plugin, SearchContext *sc, ChallengeOptions *options, int32_t offset, char *crashed)
+{
+	std::vector<Point> out(options->resultCount);
+	try {
+		for (int32_t i = 0; i < options->queryCount; ++i)
+		{
+			const Rect &query = options->queryRects[(offset + i) % options->queryCount];
+			plugin->fns.search(sc, query, options->resultCount, out.data());
+		}
+	} catch(std::exception e) {
+		*crashed = 1;
+	}
+}
+
+/* runs queries from 1, 2, 4 ... stressThreads threads at once against the same context *
+ * and reports aggregate queries per second, returns true if any errors/failures       */
+bool plugin_stress_queries(Challenger &plugin, SearchContextPtr &sc, ChallengeOptions &options)
+{
+	if ((options.stressThreads <= 0) || (options.queryCount <= 0)) return false;
+
+	printf("Stress test (queries/second):\n");
+	double single = 0.0;
+	for (int32_t threads = 1; ; threads *= 2)
+	{
+		if (threads > options.stressThreads) threads = options.stressThreads;
+
+		std::vector<std::thread> workers;
+		std::vector<char> crashed(threads, 0);
+		ps_timer timer;
+		for (int32_t t = 0; t < threads; ++t)
+		{
+			int32_t offset = (int32_t)((int64_t)options.queryCount * t / threads);
+			workers.push_back(std::thread(stress_queries, &plugin, sc, &options, offset, &crashed[t]));
+		}
+		for (int32_t t = 0; t < threads; ++t) workers[t].join();
+		double elapsed = timer.elapsed();
+
+		for (int32_t t = 0; t < threads; ++t)
+		{
+			if (crashed[t]) { printf("CRASHED!\n"); return true; }
+		}
+		double qps = (elapsed > 0.0) ? 1000.0 * threads * options.queryCount / elapsed : 0.0;
+		if (threads == 1) single = qps;
+		printf("  %3d thread%s: %12.0f (%.2fx)\n", threads, (threads == 1) ? " " : "s", qps, (single > 0.0) ? qps / single : 0.0);
+
+		if (threads >= options.stressThreads) break;
+	}
+	return false;
+}
+
 /* cleanup */
 void plugin_release_points(Challenger &plugin, SearchContextPtr &sc)
 {
@@ -374,44 +642,75 @@ void plugin_release_points(Challenger &plugin, SearchContextPtr &sc)
 int _tmain(int argc, TCHAR* argv[])
 {
 	ChallengeOptions options;
-	Rankings rankings;
 
 	print_welcome_message();
     initialize_default_options(options);
 	process_command_line_arguments(argc, argv, options);
+	if (!options.loadDataPath.empty() && load_data_file(options)) return 1;
 	print_options(options);
 	load_all_plugins(options);
+	Rankings rankings((RankChallengerResults(options.metric)));
+
+	if ((options.plugins.size() > 0) || !options.saveDataPath.empty()) {
+		if (options.loadDataPath.empty()) {
+			if ((options.pointCount < 0) || (options.pointCount > MAX_GENERATED_POINTS)) {
+				printf("Point count %lld can not be generated, at most %lld points get unique ranks.\n",
+					(long long)options.pointCount, (long long)MAX_GENERATED_POINTS);
+				return 1;
+			}
+			generate_random_points(options, hardware_threads());
+			generate_random_query_rects(options);
+		}
+		if (!options.saveDataPath.empty()) save_data_file(options);
+	}
 
 	if (options.plugins.size() > 0) {
-		generate_random_points(options.pointCount, options.points);
-		generate_random_query_rects(options.queryCount, options.queryRects);
+		prepare_expected_results(options);
 
 		/* run the challenge */
+		std::vector<ChallengerResults> results;
 		for (size_t i=0; i < options.plugins.size(); i++)
 		{
 			_tprintf(_T("\nTesting algorithm #%d (%s):\n"), i, options.plugins[i].name.c_str());
-			/* reserve space for all searches with all query rects */
-			options.plugins[i].results = new Point[options.queryCount * options.resultCount];
 			/* snapshot memory so can obtain usage information */
 			options.plugins[i].pi.start();
 			SearchContext *sc;
 			if (plugin_ruggedness_check(options.plugins[i], options)) continue;
 			if (plugin_load_points(options.plugins[i], sc, options)) continue;
 			ChallengerResults cResults = plugin_make_queries(options.plugins[i], sc, options);
-			rankings.push(cResults);
+			results.push_back(cResults);
 			if (cResults.searchTime == CRASHED_TIME) continue;
+			if (plugin_stress_queries(options.plugins[i], sc, options)) continue;
 			plugin_release_points(options.plugins[i], sc);
 		}
 
-		/* validate results */
+		/* validate results, only plugins whose every result was exact are ranked */
 		printf("\nComparing the results of algorithms:\n");
-		printf("TODO!\n");
+		for (size_t i=0; i < options.plugins.size(); i++)
+		{
+			Challenger &plugin = options.plugins[i];
+			if (!plugin.checked)
+				_tprintf(_T("%s: did not complete its queries, excluded from scoreboard\n"), plugin.name.c_str());
+			else if (plugin.mismatches == 0)
+				_tprintf(_T("%s: all %d queries match\n"), plugin.name.c_str(), options.queryCount);
+			else
+				_tprintf(_T("%s: %d of %d queries differ (first: query #%d), excluded from scoreboard\n"), plugin.name.c_str(),
+					plugin.mismatches, options.queryCount, plugin.firstMismatch);
+		}
+		for (size_t i=0; i < results.size(); i++)
+		{
+			if (results[i].challenger->checked && (results[i].challenger->mismatches == 0)) rankings.push(results[i]);
+		}
 
 		/* print rankings */
-		printf("\nScoreboard:\n");
+		printf("\nScoreboard (by %s latency):\n", score_metric_name(options.metric));
 		for (size_t rank = 0; !rankings.empty(); ++rank) {
 			ChallengerResults cResults = rankings.top();
-			_tprintf(_T("#%d: %.4fms %s\n"), rank, cResults.searchTime, cResults.challenger->name.c_str());
+			if (cResults.batchTime != CRASHED_TIME)
+				_tprintf(_T("#%d: %.2fus (%.4fms total, %.4fms as a batch) %s\n"), rank, cResults.score(options.metric), cResults.searchTime,
+					cResults.batchTime, cResults.challenger->name.c_str());
+			else
+				_tprintf(_T("#%d: %.2fus (%.4fms total) %s\n"), rank, cResults.score(options.metric), cResults.searchTime, cResults.challenger->name.c_str());
 			rankings.pop();
 		}
 
@@ -43,7 +43,8 @@ void ps_timer::start(void)
 void ps_timer::stop(void)
 {
 	QueryPerformanceCounter(&m_stop);
-	m_count += m_stop.QuadPart - m_start.QuadPart;
+	m_last = m_stop.QuadPart - m_start.QuadPart;
+	m_count += m_last;
 }
 
 /*  clear existing time, ie restart */
@@ -51,6 +52,7 @@ void ps_timer::reset(void)
 {
 	/* init running count, total counts between all start()-stop() calls */
 	m_count = 0ul;	
+	m_last = 0ul;
 }
 
 /* return how much time passed between start & stop call in microseconds */
@@ -67,3 +69,10 @@ double ps_timer::elapsed(void)
 	return totalCounts * conversionFactor;
 }
 
+/* return nanoseconds between the most recent start & stop call alone, minus overhead of the timing */
+uint64_t ps_timer::lastNanoseconds(void)
+{
+	register LONGLONG counts = m_last - m_overhead;
+	if (counts <= 0) return 0;
+	return static_cast<uint64_t>(counts * conversionFactor * 1000000.0 + 0.5);
+}
@@ -3,6 +3,7 @@
 #define __PS_TIMER__
 
 #include <Windows.h>
+#include <stdint.h>
 
 class ps_timer
 {
@@ -18,6 +19,8 @@ public:
 	void reset(void);
 	/* return how much time passed between start & stop call in microseconds, invokes stop if not already called */
 	double elapsed(void);
+	/* return nanoseconds between the most recent start & stop call alone */
+	uint64_t lastNanoseconds(void);
 
 private:
 	/* calculate extra time used to perform the timing calculations & reset() */
@@ -29,6 +32,7 @@ private:
 	double conversionFactor;
 	LONGLONG m_overhead;
 	LONGLONG m_count;
+	LONGLONG m_last;
 };
 
 
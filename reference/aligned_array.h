@@ -0,0 +1,90 @@
+#pragma once
+#ifndef __ALIGNED_ARRAY__
+#define __ALIGNED_ARRAY__
+
+#include <stddef.h>
+#include <string.h>  /* for memcpy */
+#include "page_memory.h"
+
+/* alignment of every AlignedArray, a cache line so SIMD loads of a column never straddle one needlessly */
+#define ARRAY_ALIGNMENT 64
+
+/* Fixed size array of plain (memcpy-able) elements aligned to ARRAY_ALIGNMENT.  Used for the column
+   storage of the reference plugin where std::vector's default alignment is not enough for aligned
+   SIMD loads.  Large arrays may be backed by huge pages (see allocatePages) to spare the TLB misses of
+   random access.  An array may instead view memory owned elsewhere, such as a mapped index file, which
+   it then never writes or frees.  Not copyable, ownership stays with the object that allocated it. */
+template <typename T>
+class AlignedArray
+{
+public:
+	AlignedArray(void) : items(NULL), count(0), mode(PAGES_SMALL), owned(true), locked(false) {}
+	~AlignedArray(void) { clear(); }
+
+	/* discard contents and allocate room for count uninitialized elements, backed by pages of at best
+	   the requested mode, returns false if out of memory */
+	bool resize(size_t count, PageMode pages = PAGES_SMALL)
+	{
+		clear();
+		if (count == 0) return true;
+		items = (T *)allocatePages(count * sizeof(T), ARRAY_ALIGNMENT, pages, mode);
+		if (items == NULL) return false;
+		this->count = count;
+		return true;
+	}
+
+	/* discard contents and copy count elements from items, returns false if out of memory */
+	bool assign(const T *items, size_t count, PageMode pages = PAGES_SMALL)
+	{
+		if (!resize(count, pages)) return false;
+		if (count > 0) memcpy(this->items, items, count * sizeof(T));
+		return true;
+	}
+
+	/* discard contents and view count elements at items, which must stay valid (and unwritten) until cleared */
+	void view(const T *items, size_t count)
+	{
+		clear();
+		this->items = const_cast<T *>(items);
+		this->count = count;
+		owned = false;
+	}
+
+	/* release memory, or stop viewing it, unlocking it first if report locked it */
+	void clear(void)
+	{
+		if (locked) unlockPages(items, count * sizeof(T));
+		if (owned) freePages(items, count * sizeof(T), mode);
+		items = NULL;
+		count = 0;
+		mode = PAGES_SMALL;
+		owned = true;
+		locked = false;
+	}
+
+	/* adds array to report, prefaulting and locking it as asked */
+	void report(PageReport &report, bool prefault, bool lock) const
+	{
+		if (reportPages(report, items, count * sizeof(T), mode, prefault, lock && !locked)) locked = true;
+	}
+
+	size_t size(void) const { return count; }
+	bool empty(void) const { return count == 0; }
+	T *data(void) { return items; }
+	const T *data(void) const { return items; }
+	T &operator[](size_t i) { return items[i]; }
+	const T &operator[](size_t i) const { return items[i]; }
+
+private:
+	/* not copyable */
+	AlignedArray(const AlignedArray &);
+	AlignedArray &operator=(const AlignedArray &);
+
+	T *items;
+	size_t count;
+	PageMode mode;    /* pages actually backing items */
+	bool owned;       /* items allocated here, rather than viewed */
+	mutable bool locked;  /* items locked by report, so unlocked before freed */
+};
+
+#endif /* __ALIGNED_ARRAY__ */
@@ -0,0 +1,670 @@
+#include "block_index.h"
+#include "rank_merge.h"
+#include "parallel_for.h"
+#include <limits.h>  /* for INT32_MAX */
+#include <algorithm> /* for std::nth_element, std::sort, std::partial_sort, std::copy, std::min, std::upper_bound */
+#include <functional> /* for std::cref */
+
+
+/* orders Points by a single coordinate, used to split a set of Points at its median */
+struct PointXLess {
+	bool operator()(const Point &a, const Point &b) const { return a.x < b.x; }
+};
+struct PointYLess {
+	bool operator()(const Point &a, const Point &b) const { return a.y < b.y; }
+};
+
+/* position within a block during a two stage (quantized then float) scan */
+struct QuantCursor {
+	size_t cur;          /* next matching Point                                        */
+	size_t end;          /* one past last Point in block                                */
+	bool inside;         /* block lies entirely within rect, so every Point matches     */
+	QuantRect candidate; /* quantized coordinates any matching Point must have          */
+	int32_t lx, ly;      /* quantized coordinates strictly between these (unbiased) ... */
+	int32_t hx, hy;      /* ... belong to Points certainly within rect                  */
+};
+
+/* moves QuantCursors forward to the next Point within rect, floats are only read for Points whose
+   quantized coordinates fall on the quantized rect edge */
+struct QuantFilter {
+	const PointColumns *columns;
+	const int16_t *qxs;
+	const int16_t *qys;
+	Rect rect;
+	FindCandidateFunc findCandidate;
+
+	/* returns false if block has no more matches */
+	inline bool advance(QuantCursor &c) const
+	{
+		if (c.inside) return c.cur < c.end;
+		for (;;)
+		{
+			c.cur = findCandidate(qxs, qys, c.cur, c.end, c.candidate);
+			if (c.cur >= c.end) return false;
+			int32_t qx = qxs[c.cur] + 32768, qy = qys[c.cur] + 32768;
+			if ((qx > c.lx) & (qx < c.hx) & (qy > c.ly) & (qy < c.hy)) return true;
+			if (columns->inRect(c.cur, rect)) return true;
+			++c.cur;
+		}
+	}
+};
+
+/* quantized block relative coordinate, 0 to 65535.  Only subtraction, multiplication by a non-negative
+   constant, clamping and truncation are used, each monotonic, so v <= w implies quantize(v) <= quantize(w)
+   and the same function applied to a rect bound orders Points against it conservatively. */
+static inline int32_t quantize(float v, float low, float inv)
+{
+	float f = (v - low) * inv;
+	if (!(f > 0.0f)) return 0;
+	if (f >= 65535.0f) return 65535;
+	return (int32_t)f;
+}
+
+/* The storages a band search reads, each through the same calls: open() places a cursor on the Points of a
+   block (given by index and box) without testing any, advance() moves it to its next match, inRect() and point() read single Points by
+   position and merge() merges the matches of a band's cursors by rank. */
+
+/* the packed Points passed to build, tested as they are */
+struct PackedBands {
+	typedef RankCursor Cursor;
+	const Point *points;
+	Rect rect;
+
+	inline void open(Cursor &c, size_t, const BlockBox &, size_t begin, size_t end, bool inside) const
+	{
+		c.cur = points + begin;
+		c.end = points + end;
+		c.inside = inside;
+	}
+	inline bool advance(Cursor &c) const { return ::advance(c, rect); }
+	inline bool inRect(size_t i) const { return ::inRect(points[i], rect); }
+	inline Point point(size_t i) const { return points[i]; }
+	inline int32_t merge(Cursor *heap, size_t size, int32_t matches, const int32_t count, Point *out_points) const
+	{
+		return mergeByRank(heap, size, rect, matches, count, out_points);
+	}
+};
+
+/* a column copy of them, tested with a filter kernel */
+struct ColumnBands {
+	typedef ColumnCursor Cursor;
+	ColumnFilter filter;
+
+	inline void open(Cursor &c, size_t, const BlockBox &, size_t begin, size_t end, bool inside) const
+	{
+		c.cur = begin;
+		c.end = end;
+		c.inside = inside;
+	}
+	inline bool advance(Cursor &c) const { return filter.advance(c); }
+	inline bool inRect(size_t i) const { return filter.columns->inRect(i, filter.rect); }
+	inline Point point(size_t i) const { return filter.columns->point(i); }
+	inline int32_t merge(Cursor *heap, size_t size, int32_t matches, const int32_t count, Point *out_points) const
+	{
+		return mergeByRank(heap, size, *filter.columns, filter, matches, count, out_points);
+	}
+};
+
+/* the same columns with quantized coordinates tested first, quant holding the transform of each block */
+struct QuantBands {
+	typedef QuantCursor Cursor;
+	QuantFilter filter;
+	const BlockQuant *quant;
+
+	inline void open(Cursor &c, size_t block, const BlockBox &box, size_t begin, size_t end, bool inside) const
+	{
+		c.cur = begin;
+		c.end = end;
+		c.inside = inside;
+		if (inside) return;
+
+		/* rect edges outside the box constrain nothing, the rest quantize like the Points do */
+		const Rect &rect = filter.rect;
+		const BlockQuant &q = quant[block];
+		c.lx = (rect.lx <= box.lx) ? -1 : ::quantize(rect.lx, q.lx, q.invX);
+		c.hx = (rect.hx >= box.hx) ? 65536 : ::quantize(rect.hx, q.lx, q.invX);
+		c.ly = (rect.ly <= box.ly) ? -1 : ::quantize(rect.ly, q.ly, q.invY);
+		c.hy = (rect.hy >= box.hy) ? 65536 : ::quantize(rect.hy, q.ly, q.invY);
+		c.candidate.lx = (int16_t)(((c.lx < 0) ? 0 : c.lx) - 32768);
+		c.candidate.hx = (int16_t)(((c.hx > 65535) ? 65535 : c.hx) - 32768);
+		c.candidate.ly = (int16_t)(((c.ly < 0) ? 0 : c.ly) - 32768);
+		c.candidate.hy = (int16_t)(((c.hy > 65535) ? 65535 : c.hy) - 32768);
+	}
+	inline bool advance(Cursor &c) const { return filter.advance(c); }
+	inline bool inRect(size_t i) const { return filter.columns->inRect(i, filter.rect); }
+	inline Point point(size_t i) const { return filter.columns->point(i); }
+	inline int32_t merge(Cursor *heap, size_t size, int32_t matches, const int32_t count, Point *out_points) const
+	{
+		return mergeByRank(heap, size, *filter.columns, filter, matches, count, out_points);
+	}
+};
+
+BlockIndex::BlockIndex(void)
+{
+	count = 0;
+	blockSize = DEFAULT_BLOCK_SIZE;
+}
+
+/* computes bounding box of points [begin,end), which must not be empty */
+static BlockBox boundingBox(const Point *begin, const Point *end)
+{
+	BlockBox box = { begin->x, begin->y, begin->x, begin->y };
+	for (const Point *p = begin + 1; p < end; ++p)
+	{
+		if (p->x < box.lx) box.lx = p->x;
+		if (p->x > box.hx) box.hx = p->x;
+		if (p->y < box.ly) box.ly = p->y;
+		if (p->y > box.hy) box.hy = p->y;
+	}
+	return box;
+}
+
+/* recursively split points [begin,end) into blocks of at most blockSize, appending each block found to boxes and starts */
+void BlockIndex::split(Point *points, size_t begin, size_t end, std::vector<BlockBox> &boxes, std::vector<size_t> &starts) const
+{
+	BlockBox box = boundingBox(points + begin, points + end);
+	size_t size = end - begin;
+	if (size <= blockSize)
+	{
+		/* small enough, restore rank order within block and record it */
+		std::sort(points + begin, points + end, PointRankLess());
+		boxes.push_back(box);
+		starts.push_back(begin);
+		return;
+	}
+
+	/* divide so each half holds a whole number of full blocks where possible */
+	size_t blocks = (size + blockSize - 1) / blockSize;
+	size_t mid = begin + size * (blocks / 2) / blocks;
+
+	/* split across the longer side of the box to keep blocks compact */
+	if ((box.hx - box.lx) >= (box.hy - box.ly))
+		std::nth_element(points + begin, points + mid, points + end, PointXLess());
+	else
+		std::nth_element(points + begin, points + mid, points + end, PointYLess());
+	split(points, begin, mid, boxes, starts);
+	split(points, mid, end, boxes, starts);
+}
+
+/* reorders rank sorted points into banded, spatially blocked order and computes block boxes, bands are split on up to threads threads,
+   returns false (leaving the index empty) if out of memory */
+bool BlockIndex::build(Point *points, size_t count, size_t blockSize, size_t bandBlocks, size_t threads)
+{
+	this->count = count;
+	this->blockSize = (blockSize > 0) ? blockSize : DEFAULT_BLOCK_SIZE;
+	if (bandBlocks < 1) bandBlocks = 1;
+	if (bandBlocks > MAX_BAND_BLOCKS) bandBlocks = MAX_BAND_BLOCKS;
+	size_t bandSize = this->blockSize * bandBlocks;
+
+	boxes.clear();
+	blockStart.clear();
+	bandStart.clear();
+	bandMinRank.clear();
+	bandTops.clear();
+	quant.clear();
+	qxs.clear();
+	qys.clear();
+
+	/* bands hold consecutive ranks, only the order of Points within a band changes, so each band splits on its own */
+	size_t bands = (count + bandSize - 1) / bandSize;
+	std::vector<std::vector<BlockBox> > bandBoxes(bands);
+	std::vector<std::vector<size_t> > bandStarts(bands);
+	std::vector<int32_t> minRanks(bands);
+	std::vector<uint32_t> tops(bands * BAND_TOP_POINTS, 0);
+	parallelFor(threads, bands, [&](size_t band) {
+		size_t begin = band * bandSize, end = std::min(begin + bandSize, count);
+		minRanks[band] = points[begin].rank;
+		bandBoxes[band].reserve(bandBlocks + 1);
+		bandStarts[band].reserve(bandBlocks + 1);
+		split(points, begin, end, bandBoxes[band], bandStarts[band]);
+
+		/* then list where the lowest ranks ended up */
+		std::vector<uint32_t> offsets(end - begin);
+		for (size_t i = 0; i < offsets.size(); i++) offsets[i] = (uint32_t)i;
+		size_t listed = std::min(offsets.size(), (size_t)BAND_TOP_POINTS);
+		std::partial_sort(offsets.begin(), offsets.begin() + listed, offsets.end(),
+			[points, begin](uint32_t a, uint32_t b) { return points[begin + a].rank < points[begin + b].rank; });
+		std::copy(offsets.begin(), offsets.begin() + listed, tops.begin() + band * BAND_TOP_POINTS);
+	});
+
+	/* then blocks of all bands join in band order */
+	size_t blocks = 0;
+	for (size_t band = 0; band < bands; band++) blocks += bandBoxes[band].size();
+	if (!boxes.resize(blocks) || !blockStart.resize(blocks + 1) || !bandStart.resize(bands + 1))
+	{
+		clear();
+		return false;
+	}
+	size_t block = 0;
+	for (size_t band = 0; band < bands; band++)
+	{
+		bandStart[band] = block;
+		for (size_t i = 0; i < bandBoxes[band].size(); i++, block++)
+		{
+			boxes[block] = bandBoxes[band][i];
+			blockStart[block] = bandStarts[band][i];
+		}
+	}
+	bandStart[bands] = blocks;
+	blockStart[blocks] = count;
+	if (!bandMinRank.assign(minRanks.empty() ? NULL : &minRanks[0], bands) || !bandTops.assign(tops.empty() ? NULL : &tops[0], tops.size()))
+	{
+		clear();
+		return false;
+	}
+	return true;
+}
+
+/* Points of block expected within rect, taking them as spread evenly over its box */
+static inline double coveredPoints(const BlockBox &box, const Rect &rect, bool inside, size_t points)
+{
+	if (inside) return (double)points;
+	double share = (double)points;
+	if (box.hx > box.lx) share *= (std::min(box.hx, rect.hx) - std::max(box.lx, rect.lx)) / (box.hx - box.lx);
+	if (box.hy > box.ly) share *= (std::min(box.hy, rect.hy) - std::max(box.ly, rect.ly)) / (box.hy - box.ly);
+	return share;
+}
+
+/* whether the top list of band, given the Points of its blocks expected within rect, likely holds need matches */
+bool BlockIndex::worthTops(size_t band, double covered, int32_t need) const
+{
+	/* a list that runs out costs at most BAND_TOP_POINTS tests on top of the merge, so only try it when
+	   the share of the band expected within rect would give twice the matches needed from the list */
+	if (bandTops.empty() || (need > BAND_TOP_POINTS)) return false;
+	size_t points = blockStart[bandStart[band + 1]] - blockStart[bandStart[band]];
+	size_t listed = std::min(points, (size_t)BAND_TOP_POINTS);
+	return covered * (double)listed >= 2.0 * (double)need * (double)points;
+}
+
+/* the lowest ranked matches of band, up to need, from its top list, -1 if it ran out while the band holds more Points */
+template <typename InRectAt, typename PointAt>
+int32_t BlockIndex::searchTops(size_t band, int32_t need, Point *out_points, const InRectAt &inRectAt, const PointAt &pointAt) const
+{
+	size_t first = blockStart[bandStart[band]], points = blockStart[bandStart[band + 1]] - first;
+	size_t listed = std::min(points, (size_t)BAND_TOP_POINTS);
+	const uint32_t *tops = bandTops.data() + band * BAND_TOP_POINTS;
+	/* every Point not listed ranks above all listed ones, so matches among the list come first in the band */
+	int32_t found = 0;
+	for (size_t i = 0; (i < listed) && (found < need); i++)
+		if (inRectAt(first + tops[i])) out_points[found++] = pointAt(first + tops[i]);
+	return ((found < need) && (listed < points)) ? -1 : found;
+}
+
+/* find() over the rank of each position as given by rankAt */
+template <typename RankAt>
+size_t BlockIndex::findRank(int32_t rank, const RankAt &rankAt) const
+{
+	/* bands hold consecutive ranks, so only the last band starting at or below rank can hold it */
+	size_t bands = bandCount();
+	const int32_t *band = std::upper_bound(bandMinRank.data(), bandMinRank.data() + bands, rank);
+	if (band == bandMinRank.data()) return count;
+	size_t b = (size_t)(band - bandMinRank.data()) - 1;
+	/* each of its blocks is sorted by rank */
+	for (size_t block = bandStart[b]; block < bandStart[b + 1]; block++)
+	{
+		size_t low = blockStart[block], high = blockStart[block + 1];
+		if ((low == high) || (rank < rankAt(low)) || (rank > rankAt(high - 1))) continue;
+		while (low < high)
+		{
+			size_t mid = low + (high - low) / 2;
+			if (rankAt(mid) < rank) low = mid + 1;
+			else high = mid;
+		}
+		if (rankAt(low) == rank) return low;
+	}
+	return count;
+}
+
+/* position of the Point ranked rank in points (the array passed to build), count if there is none */
+size_t BlockIndex::find(const Point *points, int32_t rank) const
+{
+	return findRank(rank, [points](size_t i) { return points[i].rank; });
+}
+
+/* position of the Point ranked rank in columns (a copy of the array passed to build), count if there is none */
+size_t BlockIndex::find(const PointColumns &columns, int32_t rank) const
+{
+	return findRank(rank, [&columns](size_t i) { return columns.rank(i); });
+}
+
+/* same contract as search() export, points must be the same array passed to build */
+int32_t BlockIndex::search(const Point *points, const Rect &rect, const int32_t count, Point *out_points) const
+{
+	if (count <= 0) return 0;
+	PackedBands storage = { points, rect };
+	return searchBandsIn(storage, rect, count, out_points, 0, bandCount(), NULL);
+}
+
+/* as above, over a column copy of the array passed to build, testing Points with findMatch, or when
+   quantized and findCandidate is given with findCandidate on quantized coordinates first */
+int32_t BlockIndex::search(const PointColumns &columns, const Rect &rect, const int32_t count, Point *out_points, FindMatchFunc findMatch, FindCandidateFunc findCandidate) const
+{
+	return searchBands(columns, rect, count, out_points, findMatch, findCandidate, 0, bandCount(), NULL);
+}
+
+/* as above over bands [firstBand,endBand) only, stopping at the first band whose lowest rank is above cutoff (if given) */
+int32_t BlockIndex::searchBands(const PointColumns &columns, const Rect &rect, const int32_t count, Point *out_points, FindMatchFunc findMatch,
+	FindCandidateFunc findCandidate, size_t firstBand, size_t endBand, const std::atomic<int32_t> *cutoff) const
+{
+	if (count <= 0) return 0;
+	if ((findCandidate == NULL) || !quantized())
+	{
+		ColumnBands storage = { { &columns, rect, findMatch } };
+		return searchBandsIn(storage, rect, count, out_points, firstBand, endBand, cutoff);
+	}
+
+	/* inverted or NaN bounds match nothing, and would not quantize conservatively */
+	if (!(rect.lx <= rect.hx) || !(rect.ly <= rect.hy)) return 0;
+	QuantBands storage = { { &columns, qxs.data(), qys.data(), rect, findCandidate }, quant.data() };
+	return searchBandsIn(storage, rect, count, out_points, firstBand, endBand, cutoff);
+}
+
+/* search of bands [firstBand,endBand) of the Points storage reads, stopping at the first band whose lowest rank is above cutoff (if given) */
+template <typename Storage>
+int32_t BlockIndex::searchBandsIn(const Storage &storage, const Rect &rect, const int32_t count, Point *out_points,
+	size_t firstBand, size_t endBand, const std::atomic<int32_t> *cutoff) const
+{
+	/* keep track of matches found, initially none */
+	int32_t matches = 0;
+
+	/* blocks of a band that overlap rect, as a heap ordered by rank of next match */
+	typename Storage::Cursor heap[MAX_BAND_BLOCKS];
+
+	for (size_t band = firstBand; band < endBand; band++)
+	{
+		/* another part of a parallel search already has count matches ranking below this band */
+		if ((cutoff != NULL) && (bandMinRank[band] > cutoff->load(std::memory_order_relaxed))) break;
+
+		size_t size = 0;
+		double covered = 0.0;
+		for (size_t block = bandStart[band]; block < bandStart[band + 1]; block++)
+		{
+			/* skip whole block if its box does not overlap rect */
+			const BlockBox &box = boxes[block];
+			if ((box.hx < rect.lx) || (box.lx > rect.hx) || (box.hy < rect.ly) || (box.ly > rect.hy)) continue;
+
+			/* if box lies entirely within rect then every Point matches, no need to test each */
+			bool inside = (box.lx >= rect.lx) && (box.hx <= rect.hx) && (box.ly >= rect.ly) && (box.hy <= rect.hy);
+			storage.open(heap[size], block, box, blockStart[block], blockStart[block + 1], inside);
+			covered += coveredPoints(box, rect, inside, blockStart[block + 1] - blockStart[block]);
+			size++;
+		}
+		if (size == 0) continue;
+
+		/* when rect covers most of the band its lowest ranked Points likely hold the matches wanted */
+		if (worthTops(band, covered, count - matches))
+		{
+			int32_t found = searchTops(band, count - matches, out_points + matches,
+				[&storage](size_t i) { return storage.inRect(i); }, [&storage](size_t i) { return storage.point(i); });
+			if (found >= 0)
+			{
+				matches += found;
+				if (matches >= count) break;
+				continue;
+			}
+		}
+
+		/* only blocks holding a match take part */
+		size_t live = 0;
+		for (size_t i = 0; i < size; i++) if (storage.advance(heap[i])) heap[live++] = heap[i];
+		size = live;
+		if (size == 0) continue;
+
+		/* merge matches of overlapping blocks by rank, lowest first */
+		matches = storage.merge(heap, size, matches, count, out_points);
+		/* and if we hit the limit prior to going through all possible Points, exit early */
+		if (matches >= count) break;
+	}
+	return matches;
+}
+
+/* as search() over columns, but bands past the first serialBands are split into segments searched on pool
+   (if free) while the calling thread waits, each segment abandoning once bands rank above the shared cutoff */
+int32_t BlockIndex::searchParallel(const PointColumns &columns, const Rect &rect, const int32_t count, Point *out_points, FindMatchFunc findMatch,
+	FindCandidateFunc findCandidate, SearchPool &pool, size_t serialBands) const
+{
+	/* most searches are done within the first bands, those never pay for dispatch */
+	size_t bands = bandCount();
+	size_t first = std::min(serialBands, bands);
+	int32_t matches = searchBands(columns, rect, count, out_points, findMatch, findCandidate, 0, first, NULL);
+	if ((matches >= count) || (first >= bands)) return matches;
+
+	/* segments of consecutive bands, several per thread so early finishers pick up more */
+	int32_t need = count - matches;
+	size_t segments = std::min(bands - first, (pool.size() + 1) * PARALLEL_SEGMENTS_PER_THREAD);
+	/* results of each segment are kept per calling thread, so after the first fan-out on a thread none allocate
+	   unless their count is unusually large; the task reaches them through pointers, naming them inside it
+	   would reach each worker's own copy */
+	static thread_local std::vector<Point> segmentPoints;
+	static thread_local std::vector<int32_t> segmentCounts;
+	if (segmentPoints.size() < segments * (size_t)need) segmentPoints.resize(segments * (size_t)need);
+	segmentCounts.assign(segments, 0);
+	Point *found = &segmentPoints[0];
+	int32_t *foundCount = &segmentCounts[0];
+	std::atomic<int32_t> cutoff(INT32_MAX);
+	auto search = [&](size_t segment) {
+		size_t begin = first + partStart(bands - first, segments, segment), end = first + partStart(bands - first, segments, segment + 1);
+		Point *out = &found[segment * (size_t)need];
+		int32_t n = searchBands(columns, rect, need, out, findMatch, findCandidate, begin, end, &cutoff);
+		foundCount[segment] = n;
+		if (n < need) return;
+
+		/* this segment alone has need matches, nothing ranking above its last can be in the result */
+		int32_t rank = out[n - 1].rank, current = cutoff.load();
+		while ((rank < current) && !cutoff.compare_exchange_weak(current, rank)) {}
+	};
+	/* wrapping a reference never allocates, unlike a std::function holding the lambda itself */
+	if (pool.run(segments, std::cref(search)))
+	{
+		/* segments hold ascending rank ranges, so their results simply follow one another */
+		for (size_t segment = 0; (segment < segments) && (matches < count); segment++)
+		{
+			int32_t n = std::min(foundCount[segment], count - matches);
+			for (int32_t i = 0; i < n; i++) out_points[matches++] = found[segment * (size_t)need + i];
+		}
+	}
+	else
+		matches += searchBands(columns, rect, need, out_points + matches, findMatch, findCandidate, first, bands, NULL);
+
+	/* a thread keeps only modest results for its next search, so one search for very many Points does not hold them for good */
+	if (segmentPoints.size() > PARALLEL_SCRATCH_POINTS) std::vector<Point>().swap(segmentPoints);
+	return matches;
+}
+
+/* searches rects[queries[q]] for each q in [0,n), BATCH_LANES at a time, each group sharing one pass over the bands */
+void BlockIndex::searchBatch(const PointColumns &columns, const Rect *rects, const int32_t *queries, size_t n, const int32_t count, Point *out_points,
+	int32_t *out_counts, FindLanesFunc findLanes) const
+{
+	std::vector<Point> candidates[BATCH_LANES];
+	for (size_t q = 0; q < n; q += BATCH_LANES)
+		searchLanes(columns, rects, queries + q, std::min(n - q, (size_t)BATCH_LANES), count, out_points, out_counts, findLanes, candidates);
+}
+
+/* searchBatch() of at most BATCH_LANES queries, candidates being scratch for the matches of each lane within a band */
+void BlockIndex::searchLanes(const PointColumns &columns, const Rect *rects, const int32_t *queries, size_t lanes, const int32_t count, Point *out_points,
+	int32_t *out_counts, FindLanesFunc findLanes, std::vector<Point> *candidates) const
+{
+	/* unused lanes, and inverted or NaN rects, are never active so match nothing */
+	RectLanes rl;
+	int32_t matches[BATCH_LANES];
+	unsigned active = 0;
+	for (size_t lane = 0; lane < BATCH_LANES; lane++)
+	{
+		Rect rect = { 0.0f, 0.0f, 0.0f, 0.0f };
+		if (lane < lanes)
+		{
+			rect = rects[queries[lane]];
+			if ((count > 0) && (rect.lx <= rect.hx) && (rect.ly <= rect.hy)) active |= 1u << lane;
+		}
+		rl.lx[lane] = rect.lx;
+		rl.ly[lane] = rect.ly;
+		rl.hx[lane] = rect.hx;
+		rl.hy[lane] = rect.hy;
+		matches[lane] = 0;
+	}
+
+	for (size_t band = 0; (band < bandCount()) && (active != 0); band++)
+	{
+		for (size_t block = bandStart[band]; block < bandStart[band + 1]; block++)
+		{
+			/* lanes whose rect overlaps the block, those it lies inside take its lowest ranked Points untested */
+			const BlockBox &box = boxes[block];
+			size_t begin = blockStart[block], end = blockStart[block + 1];
+			unsigned overlap = 0;
+			int32_t taken[BATCH_LANES];
+			for (unsigned lanesLeft = active; lanesLeft != 0; lanesLeft &= lanesLeft - 1)
+			{
+				unsigned lane = lowestBit(lanesLeft);
+				taken[lane] = 0;
+				if ((box.hx < rl.lx[lane]) || (box.lx > rl.hx[lane]) || (box.hy < rl.ly[lane]) || (box.ly > rl.hy[lane])) continue;
+				if ((box.lx >= rl.lx[lane]) && (box.hx <= rl.hx[lane]) && (box.ly >= rl.ly[lane]) && (box.hy <= rl.hy[lane]))
+				{
+					size_t take = std::min(end - begin, (size_t)(count - matches[lane]));
+					for (size_t i = begin; i < begin + take; i++) candidates[lane].push_back(columns.point(i));
+					continue;
+				}
+				overlap |= 1u << lane;
+			}
+
+			/* every other Point read once for all the lanes, a lane leaving once it has all the block can give it */
+			for (size_t i = begin; overlap != 0; i++)
+			{
+				unsigned inside;
+				i = findLanes(columns.xs.data(), columns.ys.data(), i, end, rl, overlap, &inside);
+				if (i >= end) break;
+				Point p = columns.point(i);
+				for (; inside != 0; inside &= inside - 1)
+				{
+					unsigned lane = lowestBit(inside);
+					candidates[lane].push_back(p);
+					if (++taken[lane] >= count - matches[lane]) overlap &= ~(1u << lane);
+				}
+			}
+		}
+
+		/* each lane's matches in the band, lowest ranks first, follow those of earlier bands */
+		for (unsigned lanesLeft = active; lanesLeft != 0; lanesLeft &= lanesLeft - 1)
+		{
+			unsigned lane = lowestBit(lanesLeft);
+			std::vector<Point> &found = candidates[lane];
+			if (found.empty()) continue;
+			size_t take = std::min(found.size(), (size_t)(count - matches[lane]));
+			std::partial_sort(found.begin(), found.begin() + take, found.end(), PointRankLess());
+			Point *out = out_points + (size_t)queries[lane] * count + matches[lane];
+			for (size_t i = 0; i < take; i++) out[i] = found[i];
+			matches[lane] += (int32_t)take;
+			found.clear();
+			if (matches[lane] >= count) active &= ~(1u << lane);
+		}
+	}
+	for (size_t lane = 0; lane < lanes; lane++) out_counts[queries[lane]] = matches[lane];
+}
+
+/* adds 16 bit block relative coordinates of columns (a copy of the array passed to build), backed by pages of
+   at best the requested mode, returns false if out of memory */
+bool BlockIndex::quantize(const PointColumns &columns, size_t threads, PageMode pages)
+{
+	if (!qxs.resize(count, pages) || !qys.resize(count, pages))
+	{
+		qxs.clear();
+		qys.clear();
+		return false;
+	}
+	if (!quant.resize(boxes.size()))
+	{
+		qxs.clear();
+		qys.clear();
+		return false;
+	}
+	parallelFor(threads, bandStart.size() - 1, [&](size_t band) {
+		for (size_t block = bandStart[band]; block < bandStart[band + 1]; block++) quantizeBlock(columns, block);
+	});
+	return true;
+}
+
+/* fills quantization of block and quantized coordinates of its Points */
+void BlockIndex::quantizeBlock(const PointColumns &columns, size_t block)
+{
+	const BlockBox &box = boxes[block];
+	BlockQuant &q = quant[block];
+	q.lx = box.lx;
+	q.ly = box.ly;
+	q.invX = (box.hx > box.lx) ? 65535.0f / (box.hx - box.lx) : 0.0f;
+	q.invY = (box.hy > box.ly) ? 65535.0f / (box.hy - box.ly) : 0.0f;
+	for (size_t i = blockStart[block]; i < blockStart[block + 1]; i++)
+	{
+		qxs[i] = (int16_t)(::quantize(columns.xs[i], q.lx, q.invX) - 32768);
+		qys[i] = (int16_t)(::quantize(columns.ys[i], q.ly, q.invY) - 32768);
+	}
+}
+
+/* adds quantized coordinates to report, prefaulting and locking them as asked */
+void BlockIndex::report(PageReport &report, bool prefault, bool lock) const
+{
+	qxs.report(report, prefault, lock);
+	qys.report(report, prefault, lock);
+}
+
+/* release memory used by the index */
+void BlockIndex::clear(void)
+{
+	count = 0;
+	boxes.clear();
+	blockStart.clear();
+	bandStart.clear();
+	bandMinRank.clear();
+	bandTops.clear();
+	quant.clear();
+	qxs.clear();
+	qys.clear();
+}
+
+/* adds the index's sections to writer */
+void BlockIndex::save(IndexWriter &writer) const
+{
+	BlockIndexMeta meta = { count, blockSize };
+	writer.addValue(SECTION_BLOCK_META, meta);
+	writer.add(SECTION_BLOCK_BOXES, boxes);
+	writer.add(SECTION_BLOCK_START, blockStart);
+	writer.add(SECTION_BAND_START, bandStart);
+	writer.add(SECTION_BAND_MIN_RANK, bandMinRank);
+	if (!bandTops.empty()) writer.add(SECTION_BAND_TOPS, bandTops);
+	if (!quantized()) return;
+	writer.add(SECTION_BLOCK_QUANT, quant);
+	writer.add(SECTION_QUANT_X, qxs);
+	writer.add(SECTION_QUANT_Y, qys);
+}
+
+/* views the index saved in file, which must stay open until cleared, returns false if file holds none */
+bool BlockIndex::load(const IndexFile &file)
+{
+	clear();
+	size_t metas;
+	const BlockIndexMeta *meta = (const BlockIndexMeta *)file.section(SECTION_BLOCK_META, sizeof(BlockIndexMeta), metas);
+	if ((meta == NULL) || (metas != 1)) return false;
+	count = (size_t)meta->count;
+	blockSize = (size_t)meta->blockSize;
+	bool ok = file.view(SECTION_BLOCK_BOXES, boxes) && file.view(SECTION_BLOCK_START, blockStart) &&
+		file.view(SECTION_BAND_START, bandStart) && file.view(SECTION_BAND_MIN_RANK, bandMinRank);
+	/* sizes must agree, or searches would read past the sections */
+	ok = ok && (blockStart.size() == boxes.size() + 1) && (bandMinRank.size() + 1 == bandStart.size()) &&
+		(bandStart.empty() || (bandStart[bandStart.size() - 1] == boxes.size())) && (blockStart[boxes.size()] == count);
+	/* and the starts must only grow with no band over MAX_BAND_BLOCKS blocks, or searches would overrun their merge heaps */
+	ok = ok && (blockStart[0] == 0) && (bandStart.empty() || (bandStart[0] == 0));
+	for (size_t block = 0; ok && (block < boxes.size()); block++) ok = (blockStart[block] <= blockStart[block + 1]);
+	for (size_t band = 0; ok && (band + 1 < bandStart.size()); band++)
+		ok = (bandStart[band] <= bandStart[band + 1]) && (bandStart[band + 1] - bandStart[band] <= MAX_BAND_BLOCKS);
+	/* files saved before bands listed their lowest ranks search without the lists, and each offset must lie within its band */
+	if (ok && file.has(SECTION_BAND_TOPS))
+		ok = file.view(SECTION_BAND_TOPS, bandTops) && (bandTops.size() == bandCount() * BAND_TOP_POINTS);
+	for (size_t band = 0; ok && !bandTops.empty() && (band < bandCount()); band++)
+	{
+		size_t points = blockStart[bandStart[band + 1]] - blockStart[bandStart[band]];
+		for (size_t i = 0; ok && (i < std::min(points, (size_t)BAND_TOP_POINTS)); i++) ok = (bandTops[band * BAND_TOP_POINTS + i] < points);
+	}
+	if (ok && file.has(SECTION_BLOCK_QUANT))
+		ok = file.view(SECTION_BLOCK_QUANT, quant) && file.view(SECTION_QUANT_X, qxs) && file.view(SECTION_QUANT_Y, qys) &&
+			(quant.size() == boxes.size()) && (qxs.size() == count) && (qys.size() == count);
+	if (!ok) clear();
+	return ok;
+}
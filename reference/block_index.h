@@ -0,0 +1,170 @@
+#pragma once
+#ifndef __BLOCK_INDEX__
+#define __BLOCK_INDEX__
+
+#include <stddef.h>
+#include <vector>
+#include "point_search.h"
+#include "point_columns.h"
+#include "filter_kernels.h"
+#include "aligned_array.h"
+#include "search_pool.h"
+#include "index_file.h"
+#include <atomic>
+
+/* default maximum number of Points summarized by a single bounding box, 64-1024 work well */
+#define DEFAULT_BLOCK_SIZE 256
+/* default number of blocks a band of consecutively ranked Points is split into, at most MAX_BAND_BLOCKS */
+#define DEFAULT_BAND_BLOCKS 64
+#define MAX_BAND_BLOCKS 256
+/* default bands a parallel search scans on the calling thread before fanning out */
+#define DEFAULT_SERIAL_BANDS 64
+/* default bands within which a rect of a batch must be expected to be done for it to be searched alone, the lanes
+   of a batch only pay for themselves once they share blocks over many bands */
+#define DEFAULT_BATCH_BANDS 16
+/* segments per thread a parallel search splits the remaining bands into */
+#define PARALLEL_SEGMENTS_PER_THREAD 4
+/* most segment results (in Points) a thread keeps between parallel searches, larger ones are freed after use */
+#define PARALLEL_SCRATCH_POINTS 65536
+/* lowest ranked Points of each band listed in rank order, so searches of rects covering most of a band skip its merge */
+#define BAND_TOP_POINTS 64
+
+/* axis aligned bounding box of all Points within a block */
+struct BlockBox {
+	float lx;
+	float ly;
+	float hx;
+	float hy;
+};
+
+/* per block transform of coordinates to 16 bit offsets within the block's box */
+struct BlockQuant {
+	float lx;          /* low corner of block box            */
+	float ly;
+	float invX;        /* quantization steps per unit of x   */
+	float invY;        /* quantization steps per unit of y   */
+};
+
+/* scalars of a BlockIndex as saved in an index file */
+struct BlockIndexMeta {
+	uint64_t count;
+	uint64_t blockSize;
+};
+
+/* Splits the rank sorted Points into bands of consecutive ranks.  Each band is divided spatially (by
+   repeated median splits) into blocks of at most blockSize Points, each block is kept sorted by rank
+   and summarized by a bounding box.  A search visits bands in rank order, skips any block whose box
+   misses the query rect and merges the remaining blocks of a band by rank, so it can stop as soon as
+   count Points are found.  Every Point in a band ranks lower than every Point in the following band.
+   Optionally each Point also gets 16 bit coordinates relative to its block's box, so scans of column
+   storage first stream half the bytes per Point and only re-check floats of Points near the rect edge.
+   Rects covering most of a band would still pay for merging every block of it, so each band also lists
+   its BAND_TOP_POINTS lowest ranked Points, and when the overlapping blocks promise enough matches among
+   those the list is simply tested in order, as a scan of the rank sorted Points would. */
+class BlockIndex
+{
+public:
+	BlockIndex(void);
+
+	/* reorders rank sorted points into banded, spatially blocked order and computes block boxes, bands are split on up to threads threads,
+	   returns false (leaving the index empty) if out of memory */
+	bool build(Point *points, size_t count, size_t blockSize = DEFAULT_BLOCK_SIZE, size_t bandBlocks = DEFAULT_BAND_BLOCKS, size_t threads = 1);
+
+	/* same contract as search() export, points must be the same array passed to build */
+	int32_t search(const Point *points, const Rect &rect, const int32_t count, Point *out_points) const;
+
+	/* as above, over a column copy of the array passed to build, testing Points with findMatch, or when
+	   quantized and findCandidate is given with findCandidate on quantized coordinates first */
+	int32_t search(const PointColumns &columns, const Rect &rect, const int32_t count, Point *out_points, FindMatchFunc findMatch, FindCandidateFunc findCandidate = NULL) const;
+
+	/* as above over bands [firstBand,endBand) only, stopping at the first band whose lowest rank is above cutoff (if given) */
+	int32_t searchBands(const PointColumns &columns, const Rect &rect, const int32_t count, Point *out_points, FindMatchFunc findMatch,
+		FindCandidateFunc findCandidate, size_t firstBand, size_t endBand, const std::atomic<int32_t> *cutoff) const;
+
+	/* as search() over columns, but bands past the first serialBands are split into segments searched on pool
+	   (if free) while the calling thread waits, each segment abandoning once bands rank above the shared cutoff */
+	int32_t searchParallel(const PointColumns &columns, const Rect &rect, const int32_t count, Point *out_points, FindMatchFunc findMatch,
+		FindCandidateFunc findCandidate, SearchPool &pool, size_t serialBands = DEFAULT_SERIAL_BANDS) const;
+
+	/* searches rects[queries[q]] for each q in [0,n), same contract as search() over columns per rect, with results of
+	   rect r written to out_points + r * count and their number to out_counts[r].  Queries are taken BATCH_LANES at
+	   a time in the order given, and each group shares one pass over the bands: every block overlapping any of its
+	   rects is read once and each Point tested against all of them together with findLanes */
+	void searchBatch(const PointColumns &columns, const Rect *rects, const int32_t *queries, size_t n, const int32_t count, Point *out_points,
+		int32_t *out_counts, FindLanesFunc findLanes) const;
+
+	/* position of the Point ranked rank in points (the array passed to build) or in columns (a copy of it),
+	   count if there is none; only the blocks of the one band that can hold rank are searched */
+	size_t find(const Point *points, int32_t rank) const;
+	size_t find(const PointColumns &columns, int32_t rank) const;
+
+	/* number of Points indexed */
+	size_t size(void) const { return count; }
+
+	/* number of rank bands */
+	size_t bandCount(void) const { return bandStart.empty() ? 0 : bandStart.size() - 1; }
+
+	/* number of Points in each band but the last */
+	size_t bandSize(void) const { return bandStart.empty() ? 0 : blockStart[bandStart[1]]; }
+
+	/* adds 16 bit block relative coordinates of columns (a copy of the array passed to build), backed by pages of
+	   at best the requested mode, returns false if out of memory */
+	bool quantize(const PointColumns &columns, size_t threads = 1, PageMode pages = PAGES_SMALL);
+
+	/* adds quantized coordinates to report, prefaulting and locking them as asked */
+	void report(PageReport &report, bool prefault, bool lock) const;
+
+	/* have quantized coordinates been added? */
+	bool quantized(void) const { return !qxs.empty(); }
+
+	/* adds the index's sections to writer */
+	void save(IndexWriter &writer) const;
+
+	/* views the index saved in file, which must stay open until cleared, returns false if file holds none */
+	bool load(const IndexFile &file);
+
+	/* release memory used by the index */
+	void clear(void);
+
+private:
+	/* recursively split points [begin,end) by median until at most blockSize remain, appending blocks to boxes and starts */
+	void split(Point *points, size_t begin, size_t end, std::vector<BlockBox> &boxes, std::vector<size_t> &starts) const;
+
+	/* find() over the rank of each position as given by rankAt */
+	template <typename RankAt>
+	size_t findRank(int32_t rank, const RankAt &rankAt) const;
+
+	/* searchBatch() of at most BATCH_LANES queries, candidates being scratch for the matches of each lane within a band */
+	void searchLanes(const PointColumns &columns, const Rect *rects, const int32_t *queries, size_t lanes, const int32_t count, Point *out_points,
+		int32_t *out_counts, FindLanesFunc findLanes, std::vector<Point> *candidates) const;
+
+	/* whether the top list of band, given the Points of its blocks expected within rect, likely holds need matches */
+	bool worthTops(size_t band, double covered, int32_t need) const;
+
+	/* the lowest ranked matches of band, up to need, from its top list testing each position with inRectAt and reading
+	   it with pointAt, -1 if the list ran out first while the band holds more Points than it lists */
+	template <typename InRectAt, typename PointAt>
+	int32_t searchTops(size_t band, int32_t need, Point *out_points, const InRectAt &inRectAt, const PointAt &pointAt) const;
+
+	/* fills quantization of block and quantized coordinates of its Points */
+	void quantizeBlock(const PointColumns &columns, size_t block);
+
+	/* search of bands [firstBand,endBand) of the Points storage reads (one of the storages of block_index.cpp),
+	   stopping at the first band whose lowest rank is above cutoff (if given) */
+	template <typename Storage>
+	int32_t searchBandsIn(const Storage &storage, const Rect &rect, const int32_t count, Point *out_points,
+		size_t firstBand, size_t endBand, const std::atomic<int32_t> *cutoff) const;
+
+	size_t count;                     /* total Points indexed                         */
+	size_t blockSize;                 /* maximum Points per block                     */
+	AlignedArray<BlockBox> boxes;     /* one bounding box per block                   */
+	AlignedArray<size_t> blockStart;  /* first Point of each block, plus end sentinel */
+	AlignedArray<size_t> bandStart;   /* first block of each band, plus end sentinel  */
+	AlignedArray<int32_t> bandMinRank;/* lowest rank within each band                 */
+	AlignedArray<uint32_t> bandTops;  /* offsets of lowest ranks in each band, or none */
+	AlignedArray<BlockQuant> quant;   /* quantization of each block, when quantized   */
+	AlignedArray<int16_t> qxs;        /* quantized x of each Point, biased by -32768  */
+	AlignedArray<int16_t> qys;        /* quantized y of each Point, biased by -32768  */
+};
+
+#endif /* __BLOCK_INDEX__ */
@@ -0,0 +1,106 @@
+#include "delta_index.h"
+#include "rank_merge.h"
+#include <limits.h>  /* for INT32_MAX */
+#include <algorithm> /* for std::lower_bound, std::min */
+
+/* position of rank in added, or where it belongs */
+std::vector<Point>::const_iterator DeltaIndex::lowerBound(int32_t rank) const
+{
+	return std::lower_bound(added.begin(), added.end(), rank, [](const Point &p, int32_t r) { return p.rank < r; });
+}
+
+/* copies the live Point ranked rank into point, returns false if there is none */
+bool DeltaIndex::find(int32_t rank, const MainLookup &main, Point &point) const
+{
+	std::vector<Point>::const_iterator it = lowerBound(rank);
+	if ((it != added.end()) && (it->rank == rank))
+	{
+		point = *it;
+		return true;
+	}
+	return !removes(rank) && main(rank, point);
+}
+
+/* adds point, returns false if a live Point already has its rank */
+bool DeltaIndex::insert(const Point &point, const MainLookup &main)
+{
+	Point live;
+	if (find(point.rank, main, live)) return false;
+	added.insert(added.begin() + (lowerBound(point.rank) - added.begin()), point);
+	return true;
+}
+
+/* erases the live Point ranked rank, returns false if there is none */
+bool DeltaIndex::erase(int32_t rank, const MainLookup &main)
+{
+	/* an inserted Point just goes, any tombstone of the same rank stays to hide the main index Point */
+	std::vector<Point>::const_iterator it = lowerBound(rank);
+	if ((it != added.end()) && (it->rank == rank))
+	{
+		added.erase(added.begin() + (it - added.begin()));
+		return true;
+	}
+	Point point;
+	if (removes(rank) || !main(rank, point)) return false;
+	tombstones.push_back(point);
+	removed.insert(rank);
+	return true;
+}
+
+/* gives the live Point ranked rank newRank instead, returns false if there is none or newRank is taken (by it too) */
+bool DeltaIndex::updateRank(int32_t rank, int32_t newRank, const MainLookup &main)
+{
+	Point point, taken;
+	if (!find(rank, main, point) || find(newRank, main, taken)) return false;
+	erase(rank, main);
+	point.rank = newRank;
+	added.insert(added.begin() + (lowerBound(newRank) - added.begin()), point);
+	return true;
+}
+
+/* same contract as search() export over the main index as changed, main searching the unchanged index */
+int32_t DeltaIndex::search(const Rect &rect, const int32_t count, Point *out_points, const MainSearch &main) const
+{
+	if (count <= 0) return 0;
+
+	/* every tombstoned Point inside rect may hide one of the main index's matches, so ask for that many more */
+	size_t hidden = 0;
+	for (std::vector<Point>::const_iterator it = tombstones.begin(); it != tombstones.end(); ++it)
+		if (inRect(*it, rect)) hidden++;
+	int32_t wanted = (int32_t)std::min((size_t)count + hidden, (size_t)INT32_MAX);
+	static thread_local std::vector<Point> found;
+	found.resize(wanted);
+	int32_t matches = main(wanted, &found[0]);
+
+	/* merge live main index matches with inserted Points inside rect by rank */
+	int32_t copied = 0, i = 0;
+	std::vector<Point>::const_iterator next = added.begin();
+	while (copied < count)
+	{
+		while ((i < matches) && (hidden > 0) && removes(found[i].rank)) i++;
+		while ((next != added.end()) && !inRect(*next, rect)) ++next;
+		if ((i < matches) && ((next == added.end()) || (found[i].rank < next->rank))) out_points[copied++] = found[i++];
+		else if (next != added.end()) out_points[copied++] = *next++;
+		else break;
+	}
+	return copied;
+}
+
+/* Points now inside rect less those the main index alone has inside it */
+int64_t DeltaIndex::countChange(const Rect &rect) const
+{
+	int64_t change = 0;
+	for (std::vector<Point>::const_iterator it = added.begin(); it != added.end(); ++it)
+		if (inRect(*it, rect)) change++;
+	for (std::vector<Point>::const_iterator it = tombstones.begin(); it != tombstones.end(); ++it)
+		if (inRect(*it, rect)) change--;
+	return change;
+}
+
+/* forget all changes, once merged into the main index */
+void DeltaIndex::clear(void)
+{
+	std::vector<Point>().swap(added);
+	std::vector<Point>().swap(tombstones);
+	std::unordered_set<int32_t>().swap(removed);
+}
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef __DELTA_INDEX__
+#define __DELTA_INDEX__
+
+#include <stddef.h>
+#include <vector>
+#include <functional>
+#include <unordered_set>
+#include "point_search.h"
+
+/* Points changed since the immutable main index was built, layered over it as in a log structured merge
+   tree: inserted Points (including re-ranked ones) are kept in a small rank sorted buffer, and Points of
+   the main index that were erased or re-ranked are marked by tombstones keyed on their rank, which
+   identifies a Point.  A search asks the main index for enough extra matches to make up for the
+   tombstones inside its rect, drops tombstoned ones and merges the rest with the buffer by rank.  Every
+   change makes searches slower, by a scan of the buffer and tombstones, until compaction rebuilds the
+   main index with the changes merged in and the delta is cleared. */
+class DeltaIndex
+{
+public:
+	/* finds the main index Point ranked rank, returning false if there is none (tombstoned or not) */
+	typedef std::function<bool(int32_t rank, Point &point)> MainLookup;
+
+	/* searches the main index alone for count Points, same contract as search() export */
+	typedef std::function<int32_t(int32_t count, Point *out_points)> MainSearch;
+
+	/* has nothing changed since the main index was built? */
+	bool empty(void) const { return added.empty() && tombstones.empty(); }
+
+	/* Points inserted, and main index Points erased, since the main index was built */
+	size_t addedCount(void) const { return added.size(); }
+	size_t removedCount(void) const { return tombstones.size(); }
+
+	/* copies the live Point ranked rank into point, returns false if there is none */
+	bool find(int32_t rank, const MainLookup &main, Point &point) const;
+
+	/* adds point, returns false if a live Point already has its rank */
+	bool insert(const Point &point, const MainLookup &main);
+
+	/* erases the live Point ranked rank, returns false if there is none */
+	bool erase(int32_t rank, const MainLookup &main);
+
+	/* gives the live Point ranked rank newRank instead, returns false if there is none or newRank is taken (by it too) */
+	bool updateRank(int32_t rank, int32_t newRank, const MainLookup &main);
+
+	/* same contract as search() export over the main index as changed, main searching the unchanged index */
+	int32_t search(const Rect &rect, const int32_t count, Point *out_points, const MainSearch &main) const;
+
+	/* Points now inside rect less those the main index alone has inside it */
+	int64_t countChange(const Rect &rect) const;
+
+	/* was the main index Point ranked rank erased or re-ranked? */
+	bool removes(int32_t rank) const { return removed.find(rank) != removed.end(); }
+
+	/* Points changed in all, beyond which the owner may choose to compact */
+	size_t size(void) const { return added.size() + tombstones.size(); }
+
+	/* inserted Points, lowest rank first */
+	const std::vector<Point> &insertedPoints(void) const { return added; }
+
+	/* forget all changes, once merged into the main index */
+	void clear(void);
+
+private:
+	/* position of rank in added, or where it belongs */
+	std::vector<Point>::const_iterator lowerBound(int32_t rank) const;
+
+	std::vector<Point> added;                /* inserted Points, sorted by rank                           */
+	std::vector<Point> tombstones;           /* main index Points removed, kept flat for scans of a rect  */
+	std::unordered_set<int32_t> removed;     /* ranks of tombstones                                       */
+};
+
+#endif /* __DELTA_INDEX__ */
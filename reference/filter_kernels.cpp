@@ -0,0 +1,346 @@
+#include "filter_kernels.h"
+#include <emmintrin.h>   /* SSE2    */
+#include <immintrin.h>   /* AVX2, AVX-512 */
+#ifdef _MSC_VER
+#include <intrin.h>      /* for __cpuid, __cpuidex, _xgetbv */
+#else
+#include <cpuid.h>       /* for __get_cpuid_count */
+#endif
+
+/* MSVC compiles any intrinsic regardless of /arch, gcc and clang must be told per function */
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+
+
+/* one Point at a time, tests not short-circuited so each Point costs a single branch */
+static size_t findMatchScalar(const float *xs, const float *ys, size_t begin, size_t end, const Rect &rect)
+{
+	for (size_t i = begin; i < end; i++)
+		if ((xs[i] >= rect.lx) & (xs[i] <= rect.hx) & (ys[i] >= rect.ly) & (ys[i] <= rect.hy)) return i;
+	return end;
+}
+
+/* 4 Points per compare, movemask gives one bit per lane that matched */
+static size_t findMatchSse2(const float *xs, const float *ys, size_t begin, size_t end, const Rect &rect)
+{
+	const __m128 lx = _mm_set1_ps(rect.lx), hx = _mm_set1_ps(rect.hx);
+	const __m128 ly = _mm_set1_ps(rect.ly), hy = _mm_set1_ps(rect.hy);
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(xs + i), y = _mm_loadu_ps(ys + i);
+		__m128 in = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(x, lx), _mm_cmple_ps(x, hx)),
+			_mm_and_ps(_mm_cmpge_ps(y, ly), _mm_cmple_ps(y, hy)));
+		unsigned mask = (unsigned)_mm_movemask_ps(in);
+		if (mask != 0) return i + lowestBit(mask);
+	}
+	return findMatchScalar(xs, ys, i, end, rect);
+}
+
+/* 8 Points per compare */
+TARGET_AVX2 static size_t findMatchAvx2(const float *xs, const float *ys, size_t begin, size_t end, const Rect &rect)
+{
+	const __m256 lx = _mm256_set1_ps(rect.lx), hx = _mm256_set1_ps(rect.hx);
+	const __m256 ly = _mm256_set1_ps(rect.ly), hy = _mm256_set1_ps(rect.hy);
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(xs + i), y = _mm256_loadu_ps(ys + i);
+		__m256 in = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(x, lx, _CMP_GE_OQ), _mm256_cmp_ps(x, hx, _CMP_LE_OQ)),
+			_mm256_and_ps(_mm256_cmp_ps(y, ly, _CMP_GE_OQ), _mm256_cmp_ps(y, hy, _CMP_LE_OQ)));
+		unsigned mask = (unsigned)_mm256_movemask_ps(in);
+		if (mask != 0) return i + lowestBit(mask);
+	}
+	return findMatchScalar(xs, ys, i, end, rect);
+}
+
+/* 16 Points per compare, compare results land in mask registers and the tail is done with a masked load */
+TARGET_AVX512 static size_t findMatchAvx512(const float *xs, const float *ys, size_t begin, size_t end, const Rect &rect)
+{
+	const __m512 lx = _mm512_set1_ps(rect.lx), hx = _mm512_set1_ps(rect.hx);
+	const __m512 ly = _mm512_set1_ps(rect.ly), hy = _mm512_set1_ps(rect.hy);
+	size_t i = begin;
+	for (; i + 16 <= end; i += 16)
+	{
+		__m512 x = _mm512_loadu_ps(xs + i), y = _mm512_loadu_ps(ys + i);
+		unsigned mask = (unsigned)(_mm512_cmp_ps_mask(x, lx, _CMP_GE_OQ) & _mm512_cmp_ps_mask(x, hx, _CMP_LE_OQ) &
+			_mm512_cmp_ps_mask(y, ly, _CMP_GE_OQ) & _mm512_cmp_ps_mask(y, hy, _CMP_LE_OQ));
+		if (mask != 0) return i + lowestBit(mask);
+	}
+	if (i < end)
+	{
+		__mmask16 lanes = (__mmask16)((1u << (end - i)) - 1);
+		__m512 x = _mm512_maskz_loadu_ps(lanes, xs + i), y = _mm512_maskz_loadu_ps(lanes, ys + i);
+		unsigned mask = (unsigned)(lanes & _mm512_cmp_ps_mask(x, lx, _CMP_GE_OQ) & _mm512_cmp_ps_mask(x, hx, _CMP_LE_OQ) &
+			_mm512_cmp_ps_mask(y, ly, _CMP_GE_OQ) & _mm512_cmp_ps_mask(y, hy, _CMP_LE_OQ));
+		if (mask != 0) return i + lowestBit(mask);
+	}
+	return end;
+}
+
+
+/* quantized coordinates, one Point at a time */
+static size_t findCandidateScalar(const int16_t *qxs, const int16_t *qys, size_t begin, size_t end, const QuantRect &q)
+{
+	for (size_t i = begin; i < end; i++)
+		if ((qxs[i] >= q.lx) & (qxs[i] <= q.hx) & (qys[i] >= q.ly) & (qys[i] <= q.hy)) return i;
+	return end;
+}
+
+/* quantized coordinates, 8 Points per compare, movemask gives two bits per 16 bit lane */
+static size_t findCandidateSse2(const int16_t *qxs, const int16_t *qys, size_t begin, size_t end, const QuantRect &q)
+{
+	const __m128i lx = _mm_set1_epi16(q.lx), hx = _mm_set1_epi16(q.hx);
+	const __m128i ly = _mm_set1_epi16(q.ly), hy = _mm_set1_epi16(q.hy);
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)(qxs + i)), y = _mm_loadu_si128((const __m128i *)(qys + i));
+		__m128i out = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi16(lx, x), _mm_cmpgt_epi16(x, hx)),
+			_mm_or_si128(_mm_cmpgt_epi16(ly, y), _mm_cmpgt_epi16(y, hy)));
+		unsigned mask = ~(unsigned)_mm_movemask_epi8(out) & 0xFFFFu;
+		if (mask != 0) return i + lowestBit(mask) / 2;
+	}
+	return findCandidateScalar(qxs, qys, i, end, q);
+}
+
+/* quantized coordinates, 16 Points per compare */
+TARGET_AVX2 static size_t findCandidateAvx2(const int16_t *qxs, const int16_t *qys, size_t begin, size_t end, const QuantRect &q)
+{
+	const __m256i lx = _mm256_set1_epi16(q.lx), hx = _mm256_set1_epi16(q.hx);
+	const __m256i ly = _mm256_set1_epi16(q.ly), hy = _mm256_set1_epi16(q.hy);
+	size_t i = begin;
+	for (; i + 16 <= end; i += 16)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i *)(qxs + i)), y = _mm256_loadu_si256((const __m256i *)(qys + i));
+		__m256i out = _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi16(lx, x), _mm256_cmpgt_epi16(x, hx)),
+			_mm256_or_si256(_mm256_cmpgt_epi16(ly, y), _mm256_cmpgt_epi16(y, hy)));
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(out);
+		if (mask != 0) return i + lowestBit(mask) / 2;
+	}
+	return findCandidateScalar(qxs, qys, i, end, q);
+}
+
+/* quantized coordinates, 32 Points per compare, tail done with a masked load */
+TARGET_AVX512 static size_t findCandidateAvx512(const int16_t *qxs, const int16_t *qys, size_t begin, size_t end, const QuantRect &q)
+{
+	const __m512i lx = _mm512_set1_epi16(q.lx), hx = _mm512_set1_epi16(q.hx);
+	const __m512i ly = _mm512_set1_epi16(q.ly), hy = _mm512_set1_epi16(q.hy);
+	size_t i = begin;
+	for (; i + 32 <= end; i += 32)
+	{
+		__m512i x = _mm512_loadu_si512(qxs + i), y = _mm512_loadu_si512(qys + i);
+		unsigned mask = (unsigned)(_mm512_cmp_epi16_mask(x, lx, _MM_CMPINT_NLT) & _mm512_cmp_epi16_mask(x, hx, _MM_CMPINT_LE) &
+			_mm512_cmp_epi16_mask(y, ly, _MM_CMPINT_NLT) & _mm512_cmp_epi16_mask(y, hy, _MM_CMPINT_LE));
+		if (mask != 0) return i + lowestBit(mask);
+	}
+	if (i < end)
+	{
+		__mmask32 lanes = (__mmask32)((1u << (end - i)) - 1);
+		__m512i x = _mm512_maskz_loadu_epi16(lanes, qxs + i), y = _mm512_maskz_loadu_epi16(lanes, qys + i);
+		unsigned mask = (unsigned)(lanes & _mm512_cmp_epi16_mask(x, lx, _MM_CMPINT_NLT) & _mm512_cmp_epi16_mask(x, hx, _MM_CMPINT_LE) &
+			_mm512_cmp_epi16_mask(y, ly, _MM_CMPINT_NLT) & _mm512_cmp_epi16_mask(y, hy, _MM_CMPINT_LE));
+		if (mask != 0) return i + lowestBit(mask);
+	}
+	return end;
+}
+
+
+/* one Point at a time, tested against each active rect */
+static size_t findLanesScalar(const float *xs, const float *ys, size_t begin, size_t end, const RectLanes &lanes, unsigned active, unsigned *inside)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		unsigned mask = 0;
+		for (unsigned left = active; left != 0; left &= left - 1)
+		{
+			unsigned lane = lowestBit(left);
+			mask |= (unsigned)((xs[i] >= lanes.lx[lane]) & (xs[i] <= lanes.hx[lane]) & (ys[i] >= lanes.ly[lane]) & (ys[i] <= lanes.hy[lane])) << lane;
+		}
+		if (mask != 0) { *inside = mask; return i; }
+	}
+	return end;
+}
+
+/* first of the Points whose bits are set in the lane masks of the active rects, storing the rects it is inside */
+static inline unsigned firstInLanes(const unsigned *masks, unsigned active, unsigned *inside)
+{
+	unsigned any = 0;
+	for (unsigned lanes = active; lanes != 0; lanes &= lanes - 1) any |= masks[lowestBit(lanes)];
+	unsigned first = lowestBit(any), rects = 0;
+	for (unsigned lanes = active; lanes != 0; lanes &= lanes - 1)
+	{
+		unsigned lane = lowestBit(lanes);
+		rects |= ((masks[lane] >> first) & 1u) << lane;
+	}
+	*inside = rects;
+	return first;
+}
+
+/* 4 Points per compare, loaded once and compared with each active rect in turn */
+static size_t findLanesSse2(const float *xs, const float *ys, size_t begin, size_t end, const RectLanes &lanes, unsigned active, unsigned *inside)
+{
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(xs + i), y = _mm_loadu_ps(ys + i);
+		unsigned masks[BATCH_LANES], any = 0;
+		for (unsigned left = active; left != 0; left &= left - 1)
+		{
+			unsigned lane = lowestBit(left);
+			__m128 in = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(x, _mm_set1_ps(lanes.lx[lane])), _mm_cmple_ps(x, _mm_set1_ps(lanes.hx[lane]))),
+				_mm_and_ps(_mm_cmpge_ps(y, _mm_set1_ps(lanes.ly[lane])), _mm_cmple_ps(y, _mm_set1_ps(lanes.hy[lane]))));
+			any |= masks[lane] = (unsigned)_mm_movemask_ps(in);
+		}
+		if (any != 0) return i + firstInLanes(masks, active, inside);
+	}
+	return findLanesScalar(xs, ys, i, end, lanes, active, inside);
+}
+
+/* 8 Points per compare */
+TARGET_AVX2 static size_t findLanesAvx2(const float *xs, const float *ys, size_t begin, size_t end, const RectLanes &lanes, unsigned active, unsigned *inside)
+{
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(xs + i), y = _mm256_loadu_ps(ys + i);
+		unsigned masks[BATCH_LANES], any = 0;
+		for (unsigned left = active; left != 0; left &= left - 1)
+		{
+			unsigned lane = lowestBit(left);
+			__m256 in = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(x, _mm256_set1_ps(lanes.lx[lane]), _CMP_GE_OQ), _mm256_cmp_ps(x, _mm256_set1_ps(lanes.hx[lane]), _CMP_LE_OQ)),
+				_mm256_and_ps(_mm256_cmp_ps(y, _mm256_set1_ps(lanes.ly[lane]), _CMP_GE_OQ), _mm256_cmp_ps(y, _mm256_set1_ps(lanes.hy[lane]), _CMP_LE_OQ)));
+			any |= masks[lane] = (unsigned)_mm256_movemask_ps(in);
+		}
+		if (any != 0) return i + firstInLanes(masks, active, inside);
+	}
+	return findLanesScalar(xs, ys, i, end, lanes, active, inside);
+}
+
+/* 16 Points per compare, tail done with a masked load */
+TARGET_AVX512 static size_t findLanesAvx512(const float *xs, const float *ys, size_t begin, size_t end, const RectLanes &lanes, unsigned active, unsigned *inside)
+{
+	for (size_t i = begin; i < end; i += 16)
+	{
+		__mmask16 points = (end - i >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << (end - i)) - 1);
+		__m512 x = _mm512_maskz_loadu_ps(points, xs + i), y = _mm512_maskz_loadu_ps(points, ys + i);
+		unsigned masks[BATCH_LANES], any = 0;
+		for (unsigned left = active; left != 0; left &= left - 1)
+		{
+			unsigned lane = lowestBit(left);
+			any |= masks[lane] = (unsigned)(points & _mm512_cmp_ps_mask(x, _mm512_set1_ps(lanes.lx[lane]), _CMP_GE_OQ) &
+				_mm512_cmp_ps_mask(x, _mm512_set1_ps(lanes.hx[lane]), _CMP_LE_OQ) & _mm512_cmp_ps_mask(y, _mm512_set1_ps(lanes.ly[lane]), _CMP_GE_OQ) &
+				_mm512_cmp_ps_mask(y, _mm512_set1_ps(lanes.hy[lane]), _CMP_LE_OQ));
+		}
+		if (any != 0) return i + firstInLanes(masks, active, inside);
+	}
+	return end;
+}
+
+
+/* cpuid leaf and subleaf into regs eax, ebx, ecx, edx */
+static void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4])
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuidex(r, (int)leaf, (int)subleaf);
+	for (int i = 0; i < 4; i++) regs[i] = (unsigned)r[i];
+#else
+	if (!__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3])) regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+/* register state the operating system saves on context switch (XCR0) */
+static unsigned long long enabledRegisterState(void)
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned lo, hi;
+	__asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+/* best kernel the CPU (and operating system, for the wider registers) supports */
+FilterKernel detectFilterKernel(void)
+{
+	unsigned regs[4];
+	cpuid(0, 0, regs);
+	unsigned maxLeaf = regs[0];
+	cpuid(1, 0, regs);
+	if (!(regs[3] & (1u << 26))) return KERNEL_SCALAR;   /* SSE2 */
+
+	/* wider registers also need OSXSAVE and the OS saving their state */
+	bool osxsave = (regs[2] & (1u << 27)) != 0;
+	if (!osxsave || (maxLeaf < 7)) return KERNEL_SSE2;
+	unsigned long long state = enabledRegisterState();
+	cpuid(7, 0, regs);
+	bool avx512 = ((regs[1] & (1u << 16)) != 0) && ((regs[1] & (1u << 30)) != 0);   /* AVX-512F and BW */
+	bool avx2 = (regs[1] & (1u << 5)) != 0;             /* AVX2     */
+	if (avx512 && ((state & 0xE6) == 0xE6)) return KERNEL_AVX512;   /* XMM, YMM, opmask, ZMM state */
+	if (avx2 && ((state & 0x06) == 0x06)) return KERNEL_AVX2;       /* XMM, YMM state */
+	return KERNEL_SSE2;
+}
+
+/* resolves requested kernel, KERNEL_AUTO or one the CPU lacks falls back to the best supported */
+FilterKernel resolveFilterKernel(FilterKernel requested)
+{
+	FilterKernel best = detectFilterKernel();
+	if ((requested == KERNEL_AUTO) || (requested > best)) return best;
+	return requested;
+}
+
+/* find function of a resolved kernel */
+FindMatchFunc findMatchFunc(FilterKernel kernel)
+{
+	switch (kernel)
+	{
+	case KERNEL_SSE2: return findMatchSse2;
+	case KERNEL_AVX2: return findMatchAvx2;
+	case KERNEL_AVX512: return findMatchAvx512;
+	default: return findMatchScalar;
+	}
+}
+
+/* quantized candidate function of a resolved kernel */
+FindCandidateFunc findCandidateFunc(FilterKernel kernel)
+{
+	switch (kernel)
+	{
+	case KERNEL_SSE2: return findCandidateSse2;
+	case KERNEL_AVX2: return findCandidateAvx2;
+	case KERNEL_AVX512: return findCandidateAvx512;
+	default: return findCandidateScalar;
+	}
+}
+
+/* batch lanes function of a resolved kernel */
+FindLanesFunc findLanesFunc(FilterKernel kernel)
+{
+	switch (kernel)
+	{
+	case KERNEL_SSE2: return findLanesSse2;
+	case KERNEL_AVX2: return findLanesAvx2;
+	case KERNEL_AVX512: return findLanesAvx512;
+	default: return findLanesScalar;
+	}
+}
+
+/* short name of kernel for reports, also the value accepted by REFERENCE_KERNEL */
+const char *filterKernelName(FilterKernel kernel)
+{
+	switch (kernel)
+	{
+	case KERNEL_AUTO: return "auto";
+	case KERNEL_SSE2: return "sse2";
+	case KERNEL_AVX2: return "avx2";
+	case KERNEL_AVX512: return "avx512";
+	default: return "scalar";
+	}
+}
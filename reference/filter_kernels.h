@@ -0,0 +1,79 @@
+#pragma once
+#ifndef __FILTER_KERNELS__
+#define __FILTER_KERNELS__
+
+#include <stddef.h>
+#include "point_search.h"
+#ifdef _MSC_VER
+#include <intrin.h>      /* for _BitScanForward */
+#endif
+
+/* position of lowest one bit in mask, mask must not be 0 */
+static inline unsigned lowestBit(unsigned mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (unsigned)index;
+#else
+	return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+/* implementations of the containment test over x and y columns */
+enum FilterKernel {
+	KERNEL_AUTO,    /* best supported by the CPU, chosen with cpuid               */
+	KERNEL_SCALAR,  /* one Point at a time, any CPU                               */
+	KERNEL_SSE2,    /* 4 Points per compare, baseline of the project settings     */
+	KERNEL_AVX2,    /* 8 Points per compare                                       */
+	KERNEL_AVX512   /* 16 Points per compare (32 quantized), needs AVX-512 F + BW  */
+};
+
+/* returns the first i in [begin,end) with (xs[i],ys[i]) inside rect, or end if there is none */
+typedef size_t (*FindMatchFunc)(const float *xs, const float *ys, size_t begin, size_t end, const Rect &rect);
+
+/* inclusive bounds on quantized coordinates, stored biased by -32768 so signed 16 bit compares apply */
+struct QuantRect {
+	int16_t lx;
+	int16_t ly;
+	int16_t hx;
+	int16_t hy;
+};
+
+/* returns the first i in [begin,end) with (qxs[i],qys[i]) inside q, or end if there is none */
+typedef size_t (*FindCandidateFunc)(const int16_t *qxs, const int16_t *qys, size_t begin, size_t end, const QuantRect &q);
+
+/* rects a batch search tests every Point against at once, one per lane of an AVX2 compare */
+#define BATCH_LANES 8
+
+/* bounds of up to BATCH_LANES rects stored by coordinate, so one Point is compared with all of them at once */
+struct RectLanes {
+	float lx[BATCH_LANES];
+	float ly[BATCH_LANES];
+	float hx[BATCH_LANES];
+	float hy[BATCH_LANES];
+};
+
+/* returns the first i in [begin,end) with (xs[i],ys[i]) inside any rect of lanes whose bit is set in active, storing
+   the bits of all such rects in *inside, or end if there is none */
+typedef size_t (*FindLanesFunc)(const float *xs, const float *ys, size_t begin, size_t end, const RectLanes &lanes, unsigned active, unsigned *inside);
+
+/* best kernel the CPU (and operating system, for the wider registers) supports */
+FilterKernel detectFilterKernel(void);
+
+/* resolves requested kernel, KERNEL_AUTO or one the CPU lacks falls back to the best supported */
+FilterKernel resolveFilterKernel(FilterKernel requested);
+
+/* find function of a resolved kernel */
+FindMatchFunc findMatchFunc(FilterKernel kernel);
+
+/* quantized candidate function of a resolved kernel */
+FindCandidateFunc findCandidateFunc(FilterKernel kernel);
+
+/* batch lanes function of a resolved kernel */
+FindLanesFunc findLanesFunc(FilterKernel kernel);
+
+/* short name of kernel for reports, also the value accepted by REFERENCE_KERNEL */
+const char *filterKernelName(FilterKernel kernel);
+
+#endif /* __FILTER_KERNELS__ */
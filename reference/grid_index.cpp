@@ -0,0 +1,127 @@
+#include "grid_index.h"
+#include "rank_merge.h"
+#include "parallel_for.h"
+#include <algorithm> /* for std::sort */
+#include <math.h>    /* for sqrt */
+
+/* cursors kept on the stack, larger merges allocate */
+#define LOCAL_GRID_CURSORS 64
+
+
+GridIndex::GridIndex(void)
+{
+	dim = 0;
+	lx = ly = 0.0f;
+	invWidth = invHeight = 0.0f;
+}
+
+/* cell column (or row) containing coordinate v, low and invSize describe that axis; monotonic in v
+   so every Point within [lo,hi] lies in a cell between cellOf(lo) and cellOf(hi) */
+inline size_t GridIndex::cellOf(float v, float low, float invSize) const
+{
+	float f = (v - low) * invSize;
+	if (!(f > 0.0f)) return 0;
+	if (f >= (float)dim) return dim - 1;
+	return (size_t)f;
+}
+
+/* bucket points (any order) into cells, each cell sorted by rank on up to threads threads */
+void GridIndex::build(const Point *points, size_t count, size_t cellPoints, size_t threads)
+{
+	clear();
+	if (count == 0) return;
+
+	/* bounds of data */
+	float hx, hy;
+	lx = hx = points[0].x;
+	ly = hy = points[0].y;
+	for (const Point *p = points + 1, *pEnd = points + count; p < pEnd; ++p)
+	{
+		if (p->x < lx) lx = p->x;
+		if (p->x > hx) hx = p->x;
+		if (p->y < ly) ly = p->y;
+		if (p->y > hy) hy = p->y;
+	}
+
+	/* pick grid dimension so average cell holds about cellPoints Points */
+	if (cellPoints == 0) cellPoints = DEFAULT_GRID_CELL_POINTS;
+	dim = (size_t)sqrt((double)count / (double)cellPoints);
+	if (dim < 1) dim = 1;
+	if (dim > MAX_GRID_DIM) dim = MAX_GRID_DIM;
+	invWidth = (hx > lx) ? (float)((double)dim / ((double)hx - (double)lx)) : 0.0f;
+	invHeight = (hy > ly) ? (float)((double)dim / ((double)hy - (double)ly)) : 0.0f;
+
+	/* count Points per cell, then convert counts to starting offsets */
+	cellStart.assign(dim * dim + 1, 0);
+	for (const Point *p = points, *pEnd = points + count; p < pEnd; ++p)
+		cellStart[cellOf(p->y, ly, invHeight) * dim + cellOf(p->x, lx, invWidth) + 1]++;
+	for (size_t cell = 0; cell < dim * dim; cell++)
+		cellStart[cell + 1] += cellStart[cell];
+
+	/* scatter Points into their cells */
+	std::vector<size_t> next(cellStart.begin(), cellStart.end() - 1);
+	this->points.resize(count);
+	for (const Point *p = points, *pEnd = points + count; p < pEnd; ++p)
+		this->points[next[cellOf(p->y, ly, invHeight) * dim + cellOf(p->x, lx, invWidth)]++] = *p;
+
+	/* and rank sort each cell, threads taking runs of cells holding about equal numbers of Points */
+	size_t cells = dim * dim, slices = (threads > 1) ? threads * 4 : 1;
+	parallelFor(threads, slices, [&](size_t slice) {
+		size_t cell = std::lower_bound(cellStart.begin(), cellStart.end() - 1, partStart(count, slices, slice)) - cellStart.begin();
+		size_t cellEnd = std::lower_bound(cellStart.begin(), cellStart.end() - 1, partStart(count, slices, slice + 1)) - cellStart.begin();
+		if (slice + 1 == slices) cellEnd = cells;
+		for (; cell < cellEnd; cell++)
+			std::sort(this->points.begin() + cellStart[cell], this->points.begin() + cellStart[cell + 1], PointRankLess());
+	});
+}
+
+/* same contract as search() export, but returns -1 without searching if rect overlaps more than
+   maxCells cells (empty or not), where a rank ordered scan is expected to be quicker */
+int32_t GridIndex::search(const Rect &rect, const int32_t count, Point *out_points, size_t maxCells) const
+{
+	if ((count <= 0) || (dim == 0)) return 0;
+	/* written so NaN bounds are rejected too, cellOf would otherwise place them in the first cell */
+	if (!(rect.lx <= rect.hx) || !(rect.ly <= rect.hy)) return 0;
+
+	/* range of cells overlapping rect, only the outer ring of that range is partially covered */
+	size_t cx0 = cellOf(rect.lx, lx, invWidth), cx1 = cellOf(rect.hx, lx, invWidth);
+	size_t cy0 = cellOf(rect.ly, ly, invHeight), cy1 = cellOf(rect.hy, ly, invHeight);
+	/* counting only non-empty cells would cost a pass over them, the whole range bounds the merge well enough */
+	if ((cx1 - cx0 + 1) * (cy1 - cy0 + 1) > maxCells) return -1;
+
+	/* collect a cursor for each cell with a match */
+	RankCursor local[LOCAL_GRID_CURSORS];
+	static thread_local std::vector<RankCursor> spill;
+	RankCursor *heap = local;
+	if ((cx1 - cx0 + 1) * (cy1 - cy0 + 1) > LOCAL_GRID_CURSORS)
+	{
+		if (spill.size() < (cx1 - cx0 + 1) * (cy1 - cy0 + 1)) spill.resize((cx1 - cx0 + 1) * (cy1 - cy0 + 1));
+		heap = &spill[0];
+	}
+	const Point *base = &points[0];
+	size_t size = 0;
+	for (size_t cy = cy0; cy <= cy1; cy++)
+	{
+		const size_t *row = &cellStart[cy * dim];
+		bool innerRow = (cy > cy0) && (cy < cy1);
+		for (size_t cx = cx0; cx <= cx1; cx++)
+		{
+			RankCursor c;
+			c.cur = base + row[cx];
+			c.end = base + row[cx + 1];
+			c.inside = innerRow && (cx > cx0) && (cx < cx1);
+			if (advance(c, rect)) heap[size++] = c;
+		}
+	}
+
+	/* merge cells by rank until count found */
+	return mergeByRank(heap, size, rect, 0, count, out_points);
+}
+
+/* release memory used by the index */
+void GridIndex::clear(void)
+{
+	dim = 0;
+	std::vector<size_t>().swap(cellStart);
+	std::vector<Point>().swap(points);
+}
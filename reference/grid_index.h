@@ -0,0 +1,46 @@
+#pragma once
+#ifndef __GRID_INDEX__
+#define __GRID_INDEX__
+
+#include <stddef.h>
+#include <vector>
+#include "point_search.h"
+
+/* default average number of Points per grid cell, determines the grid dimension */
+#define DEFAULT_GRID_CELL_POINTS 32
+/* default most cells a search will merge before giving up in favor of a rank ordered scan */
+#define DEFAULT_GRID_MERGE_CELLS 1024
+/* upper limit on cells per side of grid */
+#define MAX_GRID_DIM 4096
+
+/* Buckets Points into a G x G uniform grid over the bounds of the data, with G chosen so each cell holds
+   about cellPoints Points.  Each cell keeps a copy of its Points sorted by rank.  A search merges the
+   cells overlapping the rect by rank, only testing Points of cells on the border of the rect since
+   cells strictly inside are entirely covered. */
+class GridIndex
+{
+public:
+	GridIndex(void);
+
+	/* bucket points (any order) into cells, each cell sorted by rank on up to threads threads */
+	void build(const Point *points, size_t count, size_t cellPoints = DEFAULT_GRID_CELL_POINTS, size_t threads = 1);
+
+	/* same contract as search() export, but returns -1 without searching if rect overlaps more than
+	   maxCells cells (empty or not), where a rank ordered scan is expected to be quicker */
+	int32_t search(const Rect &rect, const int32_t count, Point *out_points, size_t maxCells = DEFAULT_GRID_MERGE_CELLS) const;
+
+	/* release memory used by the index */
+	void clear(void);
+
+private:
+	/* cell column (or row) containing coordinate v, low and invSize describe that axis */
+	inline size_t cellOf(float v, float low, float invSize) const;
+
+	size_t dim;                      /* G, cells per side                               */
+	float lx, ly;                    /* low corner of data bounds                        */
+	float invWidth, invHeight;       /* cells per unit of x and y                        */
+	std::vector<size_t> cellStart;   /* first Point of each cell (row major), plus end   */
+	std::vector<Point> points;       /* Points grouped by cell, rank sorted within cell  */
+};
+
+#endif /* __GRID_INDEX__ */
@@ -0,0 +1,169 @@
+#define _CRT_SECURE_NO_WARNINGS /* fopen */
+#include "index_file.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+/* next multiple of INDEX_SECTION_ALIGNMENT at or after offset */
+static inline uint64_t alignSection(uint64_t offset)
+{
+	return (offset + INDEX_SECTION_ALIGNMENT - 1) / INDEX_SECTION_ALIGNMENT * INDEX_SECTION_ALIGNMENT;
+}
+
+/* adds count elements of elementBytes each at data as section id */
+void IndexWriter::add(uint32_t id, const void *data, size_t elementBytes, size_t count)
+{
+	IndexSectionEntry entry = { id, (uint32_t)elementBytes, 0, (uint64_t)count };
+	entries.push_back(entry);
+	this->data.push_back(data);
+}
+
+/* writes the file, returns false if it could not be written completely */
+bool IndexWriter::write(const char *path) const
+{
+	if (entries.size() > INDEX_MAX_SECTIONS) return false;
+
+	/* lay out sections one after another, each on its own page */
+	IndexFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic));
+	header.version = INDEX_FILE_VERSION;
+	header.endianTag = INDEX_FILE_ENDIAN_TAG;
+	header.sizeBytes = (uint32_t)sizeof(size_t);
+	header.sectionCount = (uint32_t)entries.size();
+	uint64_t offset = alignSection(sizeof(header));
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		header.sections[i] = entries[i];
+		header.sections[i].offset = offset;
+		offset = alignSection(offset + entries[i].elementBytes * entries[i].count);
+	}
+	header.fileBytes = offset;
+
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) return false;
+	static const char padding[INDEX_SECTION_ALIGNMENT] = { 0 };
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	uint64_t written = sizeof(header);
+	for (size_t i = 0; ok && (i < entries.size()); i++)
+	{
+		const IndexSectionEntry &entry = header.sections[i];
+		ok = fwrite(padding, 1, (size_t)(entry.offset - written), f) == entry.offset - written;
+		size_t size = (size_t)(entry.elementBytes * entry.count);
+		ok = ok && ((size == 0) || (fwrite(data[i], 1, size, f) == size));
+		written = entry.offset + size;
+	}
+	ok = ok && (fwrite(padding, 1, (size_t)(header.fileBytes - written), f) == header.fileBytes - written);
+	ok = (fclose(f) == 0) && ok;
+	if (!ok) remove(path);
+	return ok;
+}
+
+
+IndexFile::IndexFile(void)
+{
+	base = NULL;
+	bytes = 0;
+#ifdef _WIN32
+	file = mapping = NULL;
+#else
+	file = -1;
+#endif
+}
+
+IndexFile::~IndexFile(void)
+{
+	close();
+}
+
+/* maps path and checks its header, returns false (with nothing mapped) if it is not a usable index file */
+bool IndexFile::open(const char *path)
+{
+	close();
+#ifdef _WIN32
+	HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE) return false;
+	file = f;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(f, &size) || (size.QuadPart < (LONGLONG)sizeof(IndexFileHeader))) { close(); return false; }
+	bytes = (size_t)size.QuadPart;
+	mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) { close(); return false; }
+	base = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	file = ::open(path, O_RDONLY);
+	if (file < 0) return false;
+	struct stat st;
+	if ((fstat(file, &st) != 0) || (st.st_size < (off_t)sizeof(IndexFileHeader))) { close(); return false; }
+	bytes = (size_t)st.st_size;
+	void *map = mmap(NULL, bytes, PROT_READ, MAP_SHARED, file, 0);
+	base = (map == MAP_FAILED) ? NULL : (const uint8_t *)map;
+#endif
+	if (base == NULL) { close(); return false; }
+
+	/* only the header is checked, sections are used as they are */
+	const IndexFileHeader &header = *(const IndexFileHeader *)base;
+	bool ok = (memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic)) == 0) && (header.version == INDEX_FILE_VERSION) &&
+		(header.endianTag == INDEX_FILE_ENDIAN_TAG) && (header.sizeBytes == sizeof(size_t)) &&
+		(header.sectionCount <= INDEX_MAX_SECTIONS) && (header.fileBytes == bytes);
+	for (uint32_t i = 0; ok && (i < header.sectionCount); i++)
+	{
+		const IndexSectionEntry &entry = header.sections[i];
+		ok = (entry.offset % INDEX_SECTION_ALIGNMENT == 0) && (entry.offset <= bytes) && (entry.elementBytes > 0) &&
+			(entry.count <= (bytes - entry.offset) / entry.elementBytes);
+	}
+	if (!ok) close();
+	return ok;
+}
+
+/* unmaps the file, anything viewing its sections must be cleared first */
+void IndexFile::close(void)
+{
+#ifdef _WIN32
+	if (base != NULL) UnmapViewOfFile(base);
+	if (mapping != NULL) CloseHandle(mapping);
+	if (file != NULL) CloseHandle(file);
+	file = mapping = NULL;
+#else
+	if (base != NULL) munmap((void *)base, bytes);
+	if (file >= 0) ::close(file);
+	file = -1;
+#endif
+	base = NULL;
+	bytes = 0;
+}
+
+/* first element of section id, or NULL if missing or its elements are not elementBytes each; count is set to its elements */
+const void *IndexFile::section(uint32_t id, size_t elementBytes, size_t &count) const
+{
+	count = 0;
+	if (base == NULL) return NULL;
+	const IndexFileHeader &header = *(const IndexFileHeader *)base;
+	for (uint32_t i = 0; i < header.sectionCount; i++)
+	{
+		const IndexSectionEntry &entry = header.sections[i];
+		if (entry.id != id) continue;
+		if (entry.elementBytes != elementBytes) return NULL;
+		count = (size_t)entry.count;
+		return base + entry.offset;
+	}
+	return NULL;
+}
+
+/* is section id present? */
+bool IndexFile::has(uint32_t id) const
+{
+	if (base == NULL) return false;
+	const IndexFileHeader &header = *(const IndexFileHeader *)base;
+	for (uint32_t i = 0; i < header.sectionCount; i++)
+		if (header.sections[i].id == id) return true;
+	return false;
+}
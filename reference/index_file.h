@@ -0,0 +1,137 @@
+#pragma once
+#ifndef __INDEX_FILE__
+#define __INDEX_FILE__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "aligned_array.h"
+
+/* first bytes of every index file */
+#define INDEX_FILE_MAGIC "PTSEARCH"
+/* bumped whenever the layout of any section changes, older files are then refused */
+#define INDEX_FILE_VERSION 1
+/* written as is, so a file from a machine of other byte order reads back differently and is refused */
+#define INDEX_FILE_ENDIAN_TAG 0x01020304u
+/* every section starts on a page boundary of the file, so its mapping is aligned for any element */
+#define INDEX_SECTION_ALIGNMENT 4096
+/* most sections a file may hold */
+#define INDEX_MAX_SECTIONS 32
+
+/* sections of an index file, each an array of plain elements */
+enum IndexSectionId {
+	SECTION_COLUMN_X = 1,       /* PointColumns x                                  */
+	SECTION_COLUMN_Y,           /* PointColumns y                                  */
+	SECTION_COLUMN_RANK,        /* PointColumns rank                               */
+	SECTION_COLUMN_ID,          /* PointColumns id                                 */
+	SECTION_BLOCK_META,         /* BlockIndex scalars, one BlockIndexMeta          */
+	SECTION_BLOCK_BOXES,        /* BlockIndex box of each block                    */
+	SECTION_BLOCK_START,        /* BlockIndex first Point of each block, plus end  */
+	SECTION_BAND_START,         /* BlockIndex first block of each band, plus end   */
+	SECTION_BAND_MIN_RANK,      /* BlockIndex lowest rank of each band             */
+	SECTION_BLOCK_QUANT,        /* BlockIndex quantization of each block, optional */
+	SECTION_QUANT_X,            /* BlockIndex quantized x, optional                */
+	SECTION_QUANT_Y,            /* BlockIndex quantized y, optional                */
+	SECTION_PREFIX_META,        /* PrefixGrid scalars, one PrefixGridMeta          */
+	SECTION_PREFIX_SUMS,        /* PrefixGrid summed-area table                    */
+	SECTION_PLANNER_TOPS,       /* QueryPlanner lowest ranked Points               */
+	SECTION_BAND_TOPS           /* BlockIndex lowest ranks of each band, optional  */
+};
+
+/* where one section lies within the file, offsets are from the start of the file so the file can be mapped anywhere */
+struct IndexSectionEntry {
+	uint32_t id;                /* IndexSectionId                   */
+	uint32_t elementBytes;      /* size of one element              */
+	uint64_t offset;            /* byte offset of first element     */
+	uint64_t count;             /* number of elements               */
+};
+
+/* start of every index file, padded to INDEX_SECTION_ALIGNMENT */
+struct IndexFileHeader {
+	char magic[8];              /* INDEX_FILE_MAGIC without its terminator */
+	uint32_t version;           /* INDEX_FILE_VERSION                      */
+	uint32_t endianTag;         /* INDEX_FILE_ENDIAN_TAG                   */
+	uint32_t sizeBytes;         /* sizeof(size_t) of the writer            */
+	uint32_t sectionCount;      /* entries used in sections                */
+	uint64_t fileBytes;         /* total size of the file                  */
+	IndexSectionEntry sections[INDEX_MAX_SECTIONS];
+};
+
+/* Collects sections from the structures being saved, then writes header and sections in one pass.
+   Only pointers to arrays are kept, so the structures must be unchanged until write() returns. */
+class IndexWriter
+{
+public:
+	/* adds count elements of elementBytes each at data as section id */
+	void add(uint32_t id, const void *data, size_t elementBytes, size_t count);
+
+	template <typename T>
+	void add(uint32_t id, const AlignedArray<T> &array) { add(id, array.data(), sizeof(T), array.size()); }
+
+	/* adds a copy of value as a section of one element */
+	template <typename T>
+	void addValue(uint32_t id, const T &value)
+	{
+		values.push_back(std::vector<uint8_t>((const uint8_t *)&value, (const uint8_t *)&value + sizeof(T)));
+		add(id, &values.back()[0], sizeof(T), 1);
+	}
+
+	/* writes the file, returns false if it could not be written completely */
+	bool write(const char *path) const;
+
+private:
+	std::vector<IndexSectionEntry> entries;
+	std::vector<const void *> data;
+	std::vector<std::vector<uint8_t> > values;   /* copies made by addValue, their buffers stay put as values grows */
+};
+
+/* A saved index mapped read only.  Sections are used in place, nothing is read until a search touches
+   it, and processes mapping the same file share its pages in the page cache. */
+class IndexFile
+{
+public:
+	IndexFile(void);
+	~IndexFile(void);
+
+	/* maps path and checks its header, returns false (with nothing mapped) if it is not a usable index file */
+	bool open(const char *path);
+
+	/* unmaps the file, anything viewing its sections must be cleared first */
+	void close(void);
+
+	/* first element of section id, or NULL if missing or its elements are not elementBytes each; count is set to its elements */
+	const void *section(uint32_t id, size_t elementBytes, size_t &count) const;
+
+	/* views section id in array, returns false if missing or of other element size */
+	template <typename T>
+	bool view(uint32_t id, AlignedArray<T> &array) const
+	{
+		size_t count;
+		const void *items = section(id, sizeof(T), count);
+		if (items == NULL) return false;
+		array.view((const T *)items, count);
+		return true;
+	}
+
+	/* is section id present? */
+	bool has(uint32_t id) const;
+
+	/* bytes mapped */
+	size_t size(void) const { return bytes; }
+
+private:
+	/* not copyable */
+	IndexFile(const IndexFile &);
+	IndexFile &operator=(const IndexFile &);
+
+	const uint8_t *base;        /* start of mapping, NULL if none */
+	size_t bytes;
+#ifdef _WIN32
+	void *file;                 /* HANDLE of file and of its mapping */
+	void *mapping;
+#else
+	int file;
+#endif
+};
+
+#endif /* __INDEX_FILE__ */
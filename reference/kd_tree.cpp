@@ -0,0 +1,181 @@
+#include "kd_tree.h"
+#include "rank_merge.h"
+#include "parallel_for.h"
+#include <algorithm> /* for std::nth_element, std::sort, heap functions */
+
+
+/* orders Points by a single coordinate, used to split a node at its median */
+struct KdXLess {
+	bool operator()(const Point &a, const Point &b) const { return a.x < b.x; }
+};
+struct KdYLess {
+	bool operator()(const Point &a, const Point &b) const { return a.y < b.y; }
+};
+
+/* node waiting to be visited, ordered so the lowest minRank is visited first */
+struct KdVisit {
+	int32_t minRank;
+	uint32_t node;
+	bool operator<(const KdVisit &other) const { return minRank > other.minRank; }
+};
+
+
+KdTree::KdTree(void)
+{
+	leafSize = DEFAULT_KD_LEAF_SIZE;
+}
+
+/* nodes of the subtree split builds over count Points */
+size_t KdTree::nodeCount(size_t count) const
+{
+	if (count <= leafSize) return 1;
+	return 1 + nodeCount(count / 2) + nodeCount(count - count / 2);
+}
+
+/* recursively build subtree over points [begin,end) with its root at node index, returns index one past its last
+   node; subtrees deferDepth levels down are appended to deferred (when given) instead of being built */
+uint32_t KdTree::split(size_t begin, size_t end, uint32_t index, std::vector<KdSubtree> *deferred, size_t deferDepth)
+{
+	if ((deferred != NULL) && (deferDepth == 0))
+	{
+		KdSubtree subtree = { begin, end, index };
+		deferred->push_back(subtree);
+		return index + (uint32_t)nodeCount(end - begin);
+	}
+
+	KdNode node;
+	node.box.lx = node.box.hx = points[begin].x;
+	node.box.ly = node.box.hy = points[begin].y;
+	node.minRank = points[begin].rank;
+	for (size_t i = begin + 1; i < end; i++)
+	{
+		const Point &p = points[i];
+		if (p.x < node.box.lx) node.box.lx = p.x;
+		if (p.x > node.box.hx) node.box.hx = p.x;
+		if (p.y < node.box.ly) node.box.ly = p.y;
+		if (p.y > node.box.hy) node.box.hy = p.y;
+		if (p.rank < node.minRank) node.minRank = p.rank;
+	}
+	node.right = 0;
+	node.begin = (uint32_t)begin;
+	node.end = (uint32_t)end;
+
+	Point *first = points.data();
+	if (end - begin <= leafSize)
+	{
+		/* leaf, rank sort so a search can stop scanning it early */
+		std::sort(first + begin, first + end, PointRankLess());
+		nodes[index] = node;
+		return index + 1;
+	}
+
+	/* split at median across the longer side of the box */
+	size_t mid = begin + (end - begin) / 2;
+	if ((node.box.hx - node.box.lx) >= (node.box.hy - node.box.ly))
+		std::nth_element(first + begin, first + mid, first + end, KdXLess());
+	else
+		std::nth_element(first + begin, first + mid, first + end, KdYLess());
+	node.right = split(begin, mid, index + 1, deferred, deferDepth - 1);
+	nodes[index] = node;
+	return split(mid, end, node.right, deferred, deferDepth - 1);
+}
+
+/* build tree over a copy of points (any order) on up to threads threads, backed by pages of at best the
+   requested mode, returns false (leaving the tree empty) if out of memory */
+bool KdTree::build(const Point *points, size_t count, size_t leafSize, size_t threads, PageMode pages)
+{
+	clear();
+	this->leafSize = (leafSize > 0) ? leafSize : DEFAULT_KD_LEAF_SIZE;
+	if (count == 0) return true;
+
+	/* the shape of the tree depends only on count, so every node has its place before any is built */
+	if (!this->points.assign(points, count, pages) || !nodes.resize(nodeCount(count), pages))
+	{
+		clear();
+		return false;
+	}
+	if (threads <= 1)
+	{
+		split(0, count, 0);
+		return true;
+	}
+
+	/* top levels on this thread, until there are enough subtrees below them to share out */
+	size_t depth = 0;
+	while (((size_t)1 << depth) < threads * KD_SUBTREES_PER_THREAD) depth++;
+	std::vector<KdSubtree> deferred;
+	split(0, count, 0, &deferred, depth);
+	parallelFor(threads, deferred.size(), [&](size_t part) {
+		split(deferred[part].begin, deferred[part].end, deferred[part].index);
+	});
+	return true;
+}
+
+/* does node's box overlap rect? */
+static inline bool overlaps(const BlockBox &box, const Rect &rect)
+{
+	return !((box.hx < rect.lx) || (box.lx > rect.hx) || (box.hy < rect.ly) || (box.ly > rect.hy));
+}
+
+/* same contract as search() export */
+int32_t KdTree::search(const Rect &rect, const int32_t count, Point *out_points) const
+{
+	if ((count <= 0) || nodes.empty()) return 0;
+	if (!overlaps(nodes[0].box, rect)) return 0;
+
+	/* out_points doubles as a max heap on rank of best matches found, worst at top */
+	int32_t matches = 0;
+
+	/* nodes to visit, lowest minRank first, kept per thread so concurrent searches share nothing and
+	   after the first search on a thread neither allocate */
+	static thread_local std::vector<KdVisit> queue;
+	queue.clear();
+	KdVisit root = { nodes[0].minRank, 0 };
+	queue.push_back(root);
+
+	while (!queue.empty())
+	{
+		KdVisit visit = queue.front();
+		std::pop_heap(queue.begin(), queue.end());
+		queue.pop_back();
+
+		/* nothing left can improve on the count matches already found */
+		if ((matches >= count) && (visit.minRank > out_points[0].rank)) break;
+
+		const KdNode &node = nodes[visit.node];
+		if (node.right == 0)
+		{
+			/* leaf, Points are rank sorted so stop once they can no longer improve result */
+			bool inside = (node.box.lx >= rect.lx) && (node.box.hx <= rect.hx) && (node.box.ly >= rect.ly) && (node.box.hy <= rect.hy);
+			for (const Point *p = &points[node.begin], *pEnd = &points[0] + node.end; p < pEnd; ++p)
+			{
+				if ((matches >= count) && (p->rank > out_points[0].rank)) break;
+				if (inside || inRect(*p, rect)) keepBest(*p, out_points, matches, count);
+			}
+			continue;
+		}
+
+		/* queue children that overlap rect and could still improve result */
+		uint32_t children[2] = { visit.node + 1, node.right };
+		for (int i = 0; i < 2; i++)
+		{
+			const KdNode &child = nodes[children[i]];
+			if (!overlaps(child.box, rect)) continue;
+			if ((matches >= count) && (child.minRank > out_points[0].rank)) continue;
+			KdVisit next = { child.minRank, children[i] };
+			queue.push_back(next);
+			std::push_heap(queue.begin(), queue.end());
+		}
+	}
+
+	/* turn heap into lowest rank first order */
+	std::sort_heap(out_points, out_points + matches, PointRankLess());
+	return matches;
+}
+
+/* release memory used by the index */
+void KdTree::clear(void)
+{
+	nodes.clear();
+	points.clear();
+}
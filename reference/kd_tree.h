@@ -0,0 +1,76 @@
+#pragma once
+#ifndef __KD_TREE__
+#define __KD_TREE__
+
+#include <stddef.h>
+#include <vector>
+#include "point_search.h"
+#include "block_index.h"
+#include "aligned_array.h"
+
+/* default most Points held by a leaf of the k-d tree */
+#define DEFAULT_KD_LEAF_SIZE 32
+/* subtrees per thread a parallel build hands out, more balance uneven subtrees better */
+#define KD_SUBTREES_PER_THREAD 4
+
+/* node of the k-d tree, nodes are stored in preorder so the left child of node i is node i+1 */
+struct KdNode {
+	BlockBox box;      /* tight bounding box of all Points below node   */
+	int32_t minRank;   /* lowest rank of any Point below node           */
+	uint32_t right;    /* index of right child, 0 if node is a leaf      */
+	uint32_t begin;    /* first Point below node                         */
+	uint32_t end;      /* one past last Point below node                 */
+};
+
+/* subtree whose building is left for later, so subtrees can be built on several threads */
+struct KdSubtree {
+	size_t begin, end;  /* Points of subtree    */
+	uint32_t index;     /* node of its root     */
+};
+
+/* k-d tree where every node knows the lowest rank in its subtree.  A search visits nodes best first by
+   that rank and stops once the count'th best match found so far ranks lower than every node left to
+   visit, giving a bound on work that does not depend on how far down the rank order matches are. */
+class KdTree
+{
+public:
+	KdTree(void);
+
+	/* build tree over a copy of points (any order) on up to threads threads, backed by pages of at best the
+	   requested mode, returns false (leaving the tree empty) if out of memory */
+	bool build(const Point *points, size_t count, size_t leafSize = DEFAULT_KD_LEAF_SIZE, size_t threads = 1, PageMode pages = PAGES_SMALL);
+
+	/* same contract as search() export */
+	int32_t search(const Rect &rect, const int32_t count, Point *out_points) const;
+
+	/* appends the tree's Points (in leaf order) to out */
+	void copyPoints(std::vector<Point> &out) const { out.insert(out.end(), points.data(), points.data() + points.size()); }
+
+	/* adds nodes and Points to report, prefaulting and locking them as asked */
+	void report(PageReport &report, bool prefault, bool lock) const
+	{
+		nodes.report(report, prefault, lock);
+		points.report(report, prefault, lock);
+	}
+
+	/* release memory used by the index */
+	void clear(void);
+
+private:
+	/* not copyable */
+	KdTree(const KdTree &);
+	KdTree &operator=(const KdTree &);
+
+	/* nodes of the subtree split builds over count Points */
+	size_t nodeCount(size_t count) const;
+
+	/* recursively build subtree over points [begin,end) with its root at node index, returns index one past its last
+	   node; subtrees deferDepth levels down are appended to deferred (when given) instead of being built */
+	uint32_t split(size_t begin, size_t end, uint32_t index, std::vector<KdSubtree> *deferred = NULL, size_t deferDepth = 0);
+
+	size_t leafSize;                 /* most Points per leaf                        */
+	AlignedArray<KdNode> nodes;      /* flat preorder array of nodes, root first    */
+	AlignedArray<Point> points;      /* Points in leaf order, rank sorted per leaf  */
+};
+
+#endif /* __KD_TREE__ */
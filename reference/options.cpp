@@ -0,0 +1,103 @@
+#define _CRT_SECURE_NO_WARNINGS /* getenv */
+#include "options.h"
+#include "block_index.h"
+#include "grid_index.h"
+#include "kd_tree.h"
+#include "range_tree.h"
+#include "quad_tree.h"
+#include "rank_tiers.h"
+#include "query_planner.h"
+#include "parallel_for.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+/* returns value of environment variable as a positive number, or defaultValue if unset or invalid */
+static size_t envSize(const char *name, size_t defaultValue)
+{
+	const char *value = getenv(name);
+	if (value == NULL) return defaultValue;
+	long long n = atoll(value);
+	return (n > 0) ? (size_t)n : defaultValue;
+}
+
+/* returns value of environment variable as a flag, 0 | off | no | false clear it, or defaultValue if unset */
+static bool envFlag(const char *name, bool defaultValue)
+{
+	const char *value = getenv(name);
+	if ((value == NULL) || (*value == '\0')) return defaultValue;
+	return !((strcmp(value, "0") == 0) || (_stricmp(value, "off") == 0) || (_stricmp(value, "no") == 0) || (_stricmp(value, "false") == 0));
+}
+
+/* sets defaults then applies any overrides found in the environment */
+void loadSearchOptions(SearchOptions &options)
+{
+	options.engine = ENGINE_BLOCKS;
+	const char *engine = getenv("REFERENCE_ENGINE");
+	if (engine != NULL)
+	{
+		if (_stricmp(engine, "scan") == 0) options.engine = ENGINE_SCAN;
+		else if (_stricmp(engine, "grid") == 0) options.engine = ENGINE_GRID;
+		else if (_stricmp(engine, "kdtree") == 0) options.engine = ENGINE_KDTREE;
+		else if (_stricmp(engine, "rangetree") == 0) options.engine = ENGINE_RANGE;
+		else if (_stricmp(engine, "quadtree") == 0) options.engine = ENGINE_QUAD;
+		else if (_stricmp(engine, "wavelet") == 0) options.engine = ENGINE_WAVELET;
+		else if (_stricmp(engine, "tiers") == 0) options.engine = ENGINE_TIERS;
+		else if (_stricmp(engine, "planner") == 0) options.engine = ENGINE_PLANNER;
+	}
+
+	options.threads = envSize("REFERENCE_THREADS", hardwareThreads());
+
+	options.searchThreads = envSize("REFERENCE_SEARCH_THREADS", 1);
+	options.serialBands = envSize("REFERENCE_SERIAL_BANDS", DEFAULT_SERIAL_BANDS);
+	options.batchBands = envSize("REFERENCE_BATCH_BANDS", DEFAULT_BATCH_BANDS);
+
+	options.sort = SORT_RADIX;
+	const char *sort = getenv("REFERENCE_SORT");
+	if (sort != NULL)
+	{
+		if (_stricmp(sort, "sample") == 0) options.sort = SORT_SAMPLE;
+		else if (_stricmp(sort, "std") == 0) options.sort = SORT_STD;
+	}
+
+	options.layout = LAYOUT_SOA;
+	const char *layout = getenv("REFERENCE_LAYOUT");
+	if ((layout != NULL) && (_stricmp(layout, "aos") == 0)) options.layout = LAYOUT_AOS;
+
+	options.kernel = KERNEL_AUTO;
+	const char *kernel = getenv("REFERENCE_KERNEL");
+	if (kernel != NULL)
+	{
+		if (_stricmp(kernel, "scalar") == 0) options.kernel = KERNEL_SCALAR;
+		else if (_stricmp(kernel, "sse2") == 0) options.kernel = KERNEL_SSE2;
+		else if (_stricmp(kernel, "avx2") == 0) options.kernel = KERNEL_AVX2;
+		else if (_stricmp(kernel, "avx512") == 0) options.kernel = KERNEL_AVX512;
+	}
+
+	options.quantize = envFlag("REFERENCE_QUANTIZE", true);
+
+	options.pages = PAGES_HUGE;
+	const char *pages = getenv("REFERENCE_PAGES");
+	if (pages != NULL)
+	{
+		if (_stricmp(pages, "transparent") == 0) options.pages = PAGES_TRANSPARENT;
+		else if (_stricmp(pages, "small") == 0) options.pages = PAGES_SMALL;
+	}
+	options.prefault = envFlag("REFERENCE_PREFAULT", true);
+	options.lock = envFlag("REFERENCE_MLOCK", false);
+
+	options.blockSize = envSize("REFERENCE_BLOCK_SIZE", DEFAULT_BLOCK_SIZE);
+	options.bandBlocks = envSize("REFERENCE_BAND_BLOCKS", DEFAULT_BAND_BLOCKS);
+	options.gridCellPoints = envSize("REFERENCE_GRID_CELL_POINTS", DEFAULT_GRID_CELL_POINTS);
+	options.gridMergeCells = envSize("REFERENCE_GRID_MERGE_CELLS", DEFAULT_GRID_MERGE_CELLS);
+	options.kdLeafSize = envSize("REFERENCE_KD_LEAF_SIZE", DEFAULT_KD_LEAF_SIZE);
+	options.rangeLeafSize = envSize("REFERENCE_RANGE_LEAF_SIZE", DEFAULT_RANGE_LEAF_SIZE);
+	options.quadTopCount = envSize("REFERENCE_QUAD_TOP_COUNT", DEFAULT_QUAD_TOP_COUNT);
+	options.quadLeafSize = envSize("REFERENCE_QUAD_LEAF_SIZE", DEFAULT_QUAD_LEAF_SIZE);
+	options.tierPoints = envSize("REFERENCE_TIER_POINTS", DEFAULT_TIER_POINTS);
+	options.tierGrowth = envSize("REFERENCE_TIER_GROWTH", DEFAULT_TIER_GROWTH);
+	options.plannerCells = envSize("REFERENCE_PLANNER_CELLS", DEFAULT_PREFIX_CELLS);
+	options.plannerDepth = envSize("REFERENCE_PLANNER_DEPTH", DEFAULT_PLANNER_DEPTH);
+	options.cacheBytes = envSize("REFERENCE_CACHE_BYTES", 0);
+	options.compactPoints = envSize("REFERENCE_COMPACT_POINTS", 0);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef __SEARCH_OPTIONS__
+#define __SEARCH_OPTIONS__
+
+#include <stddef.h>
+#include "filter_kernels.h"
+#include "page_memory.h"
+
+/* available search engines, all but the wavelet matrix and rank tiers share the banded block storage of the reference plugin;
+   every engine is preceded by the planner's shortcuts for empty rects and rects covering all the data */
+enum SearchEngine {
+	ENGINE_BLOCKS,  /* rank ordered bands of bounding boxed blocks                */
+	ENGINE_SCAN,    /* rank sorted Points in order, the fallback if blocks fail   */
+	ENGINE_GRID,    /* uniform grid of rank sorted cells merged by rank           */
+	ENGINE_KDTREE,  /* k-d tree searched best first by lowest rank in subtree     */
+	ENGINE_RANGE,   /* x range tree of y sorted Cartesian trees on rank           */
+	ENGINE_QUAD,    /* quadtree caching lowest ranked Points of every node        */
+	ENGINE_WAVELET, /* succinct wavelet matrix, replaces the block storage        */
+	ENGINE_TIERS,   /* geometric rank tiers each with a k-d tree, replaces blocks */
+	ENGINE_PLANNER  /* blocks or k-d tree per query, by estimated selectivity    */
+};
+
+/* sort used by create() to order the copied Points by rank */
+enum PointSort {
+	SORT_RADIX,     /* LSD radix sort fused with the copy, parallel over slices   */
+	SORT_SAMPLE,    /* parallel sample sort, buckets sorted with std::sort        */
+	SORT_STD        /* copy then std::sort (or qsort without USE_CPP), one thread */
+};
+
+/* storage layout of the Points searched by the block index */
+enum PointLayout {
+	LAYOUT_SOA,     /* separate aligned x, y, rank and id columns                 */
+	LAYOUT_AOS      /* packed 13 byte Points as given to create()                 */
+};
+
+/* tunables for the reference plugin, create() fills these from the environment so different
+   configurations can be compared with the same DLL, e.g. set REFERENCE_ENGINE=grid */
+struct SearchOptions {
+	SearchEngine engine;       /* REFERENCE_ENGINE           : blocks | scan | grid | kdtree | rangetree | quadtree | wavelet | tiers | planner */
+	size_t threads;            /* REFERENCE_THREADS          : threads used by create(), default all hardware threads */
+	size_t searchThreads;      /* REFERENCE_SEARCH_THREADS   : threads a single large search may fan out to, 1 (default) never fans out */
+	size_t serialBands;        /* REFERENCE_SERIAL_BANDS     : bands a search scans alone before fanning out */
+	size_t batchBands;         /* REFERENCE_BATCH_BANDS      : rects of a batch expected to be done within this many bands are searched alone */
+	PointSort sort;            /* REFERENCE_SORT             : radix | sample | std */
+	PointLayout layout;        /* REFERENCE_LAYOUT           : soa | aos, storage scanned by the block index */
+	FilterKernel kernel;       /* REFERENCE_KERNEL           : auto | scalar | sse2 | avx2 | avx512, containment test of column scans */
+	bool quantize;             /* REFERENCE_QUANTIZE         : 1 | 0, filter column scans on 16 bit block relative coordinates first */
+	PageMode pages;            /* REFERENCE_PAGES            : huge | transparent | small, best pages tried for column and engine arrays */
+	bool prefault;             /* REFERENCE_PREFAULT         : 1 | 0, touch every page of the column arrays at end of create() */
+	bool lock;                 /* REFERENCE_MLOCK            : 0 | 1, lock the column arrays in memory at end of create() */
+	size_t blockSize;          /* REFERENCE_BLOCK_SIZE       : Points per block        */
+	size_t bandBlocks;         /* REFERENCE_BAND_BLOCKS      : blocks per rank band    */
+	size_t gridCellPoints;     /* REFERENCE_GRID_CELL_POINTS : average Points per cell */
+	size_t gridMergeCells;     /* REFERENCE_GRID_MERGE_CELLS : most cells merged before falling back to blocks */
+	size_t kdLeafSize;         /* REFERENCE_KD_LEAF_SIZE     : most Points per k-d tree leaf */
+	size_t rangeLeafSize;      /* REFERENCE_RANGE_LEAF_SIZE  : most Points per range tree leaf, larger uses less memory */
+	size_t quadTopCount;       /* REFERENCE_QUAD_TOP_COUNT   : Points cached per quadtree node, best matching -r */
+	size_t quadLeafSize;       /* REFERENCE_QUAD_LEAF_SIZE   : most Points per quadtree leaf */
+	size_t tierPoints;         /* REFERENCE_TIER_POINTS      : Points in first (lowest ranked) tier */
+	size_t tierGrowth;         /* REFERENCE_TIER_GROWTH      : factor each tier grows by over the one before */
+	size_t plannerCells;       /* REFERENCE_PLANNER_CELLS    : cells per side of the prefix count grid */
+	size_t plannerDepth;       /* REFERENCE_PLANNER_DEPTH    : expected rank depth of the last match beyond which the planner uses the k-d tree */
+	size_t cacheBytes;         /* REFERENCE_CACHE_BYTES      : bytes of search results cached, 0 (default) disables the cache */
+	size_t compactPoints;      /* REFERENCE_COMPACT_POINTS   : changes after which the next change compacts them, 0 (default) only compact() does */
+};
+
+/* sets defaults then applies any overrides found in the environment */
+void loadSearchOptions(SearchOptions &options);
+
+#endif /* __SEARCH_OPTIONS__ */
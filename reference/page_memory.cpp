@@ -0,0 +1,203 @@
+#include "page_memory.h"
+#include <stdlib.h>  /* for posix_memalign, free */
+#include <string.h>  /* for strstr */
+#include <stdio.h>   /* for fopen */
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>  /* for _aligned_malloc */
+#else
+#include <sys/mman.h>
+#endif
+
+
+#ifdef _WIN32
+/* large pages need SeLockMemoryPrivilege enabled in the process token, returns true if it is */
+static bool enableLockMemoryPrivilege(void)
+{
+	static int enabled = -1;
+	if (enabled >= 0) return enabled != 0;
+	enabled = 0;
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return false;
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	if (LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) && (GetLastError() == ERROR_SUCCESS))
+		enabled = 1;
+	CloseHandle(token);
+	return enabled != 0;
+}
+#else
+/* are transparent huge pages available to madvise? not if the kernel has them set to never */
+static bool transparentHugePagesEnabled(void)
+{
+	static int enabled = -1;
+	if (enabled >= 0) return enabled != 0;
+	enabled = 0;
+	FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+	if (f == NULL) return false;
+	char line[128];
+	if ((fgets(line, sizeof(line), f) != NULL) && (strstr(line, "[never]") == NULL)) enabled = 1;
+	fclose(f);
+	return enabled != 0;
+}
+#endif
+
+/* heap memory aligned to alignment, NULL if out of memory */
+static void *alignedAllocate(size_t bytes, size_t alignment)
+{
+#ifdef _WIN32
+	return _aligned_malloc(bytes, alignment);
+#else
+	void *memory = NULL;
+	return (posix_memalign(&memory, alignment, bytes) == 0) ? memory : NULL;
+#endif
+}
+
+/* bytes rounded up to whole huge pages */
+static size_t hugeRound(size_t bytes, size_t page)
+{
+	return (bytes + page - 1) / page * page;
+}
+
+/* allocates bytes aligned to at least alignment, trying requested then each lesser mode */
+void *allocatePages(size_t bytes, size_t alignment, PageMode requested, PageMode &obtained)
+{
+	if (bytes < HUGE_PAGE_BYTES) requested = PAGES_SMALL;
+
+	if (requested >= PAGES_HUGE)
+	{
+#ifdef _WIN32
+		SIZE_T page = GetLargePageMinimum();
+		if ((page > 0) && enableLockMemoryPrivilege())
+		{
+			void *memory = VirtualAlloc(NULL, hugeRound(bytes, page), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (memory != NULL)
+			{
+				obtained = PAGES_HUGE;
+				return memory;
+			}
+		}
+#elif defined(MAP_HUGETLB)
+		void *memory = mmap(NULL, hugeRound(bytes, HUGE_PAGE_BYTES), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (memory != MAP_FAILED)
+		{
+			obtained = PAGES_HUGE;
+			return memory;
+		}
+#endif
+	}
+
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+	if ((requested >= PAGES_TRANSPARENT) && transparentHugePagesEnabled())
+	{
+		void *memory = alignedAllocate(hugeRound(bytes, HUGE_PAGE_BYTES), HUGE_PAGE_BYTES);
+		if (memory != NULL)
+		{
+			madvise(memory, hugeRound(bytes, HUGE_PAGE_BYTES), MADV_HUGEPAGE);
+			obtained = PAGES_TRANSPARENT;
+			return memory;
+		}
+	}
+#endif
+
+	obtained = PAGES_SMALL;
+	return alignedAllocate(bytes, alignment);
+}
+
+/* releases memory from allocatePages, bytes and mode as allocated */
+void freePages(void *memory, size_t bytes, PageMode mode)
+{
+	if (memory == NULL) return;
+	if (mode == PAGES_HUGE)
+	{
+#ifdef _WIN32
+		VirtualFree(memory, 0, MEM_RELEASE);
+#else
+		munmap(memory, hugeRound(bytes, HUGE_PAGE_BYTES));
+#endif
+		return;
+	}
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+/* touches every page of memory so no page faults are left for the first searches */
+void prefaultPages(const void *memory, size_t bytes)
+{
+	const volatile char *p = (const volatile char *)memory;
+	for (size_t i = 0; i < bytes; i += 4096) (void)p[i];
+	if (bytes > 0) (void)p[bytes - 1];
+}
+
+/* locks memory so it can not be paged out, returns false if not permitted */
+bool lockPages(const void *memory, size_t bytes)
+{
+	if (bytes == 0) return true;
+#ifdef _WIN32
+	return VirtualLock((LPVOID)memory, bytes) != 0;
+#else
+	return mlock(memory, bytes) == 0;
+#endif
+}
+
+/* undoes lockPages, before memory is freed so its pages stop counting against the lock limit */
+void unlockPages(const void *memory, size_t bytes)
+{
+	if (bytes == 0) return;
+#ifdef _WIN32
+	VirtualUnlock((LPVOID)memory, bytes);
+#else
+	munlock(memory, bytes);
+#endif
+}
+
+/* clears report */
+void clearPageReport(PageReport &report)
+{
+	report.bytes[PAGES_SMALL] = report.bytes[PAGES_TRANSPARENT] = report.bytes[PAGES_HUGE] = 0;
+	report.prefaulted = false;
+	report.locked = false;
+	report.lockFailed = false;
+}
+
+/* adds an array to report, prefaulting and locking it as asked, returns true if it locked the array */
+bool reportPages(PageReport &report, const void *memory, size_t bytes, PageMode mode, bool prefault, bool lock)
+{
+	if ((memory == NULL) || (bytes == 0)) return false;
+	report.bytes[mode] += bytes;
+	if (prefault)
+	{
+		prefaultPages(memory, bytes);
+		report.prefaulted = true;
+	}
+	/* explicit large pages can not be paged out anyway */
+	bool locked = false;
+	if (lock)
+	{
+		if (mode != PAGES_HUGE)
+		{
+			locked = lockPages(memory, bytes);
+			if (!locked) report.lockFailed = true;
+		}
+		report.locked = !report.lockFailed;
+	}
+	return locked;
+}
+
+/* short name of mode for reports, also the value accepted by REFERENCE_PAGES */
+const char *pageModeName(PageMode mode)
+{
+	switch (mode)
+	{
+	case PAGES_HUGE: return "huge";
+	case PAGES_TRANSPARENT: return "transparent";
+	default: return "small";
+	}
+}
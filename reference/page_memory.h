@@ -0,0 +1,50 @@
+#pragma once
+#ifndef __PAGE_MEMORY__
+#define __PAGE_MEMORY__
+
+#include <stddef.h>
+
+/* size of the large pages asked for, arrays smaller than this always use ordinary allocations */
+#define HUGE_PAGE_BYTES ((size_t)2 * 1024 * 1024)
+
+/* kind of pages backing an allocation, when requesting the best kind to try before falling back */
+enum PageMode {
+	PAGES_SMALL,        /* ordinary (4K) pages from the heap                                      */
+	PAGES_TRANSPARENT,  /* 2MB aligned heap memory advised for transparent huge pages (Linux only)   */
+	PAGES_HUGE          /* explicit large pages, MAP_HUGETLB or MEM_LARGE_PAGES, always resident    */
+};
+
+/* totals of the memory backing a set of arrays, filled in at the end of create() */
+struct PageReport {
+	size_t bytes[3];    /* bytes allocated by PageMode obtained */
+	bool prefaulted;    /* every page was touched                */
+	bool locked;        /* every array was locked in memory      */
+	bool lockFailed;    /* locking was asked for but failed      */
+};
+
+/* allocates bytes aligned to at least alignment, trying requested then each lesser mode, sets obtained
+   to the mode used, returns NULL if out of memory */
+void *allocatePages(size_t bytes, size_t alignment, PageMode requested, PageMode &obtained);
+
+/* releases memory from allocatePages, bytes and mode as allocated */
+void freePages(void *memory, size_t bytes, PageMode mode);
+
+/* touches every page of memory so no page faults are left for the first searches */
+void prefaultPages(const void *memory, size_t bytes);
+
+/* locks memory so it can not be paged out, returns false if not permitted */
+bool lockPages(const void *memory, size_t bytes);
+
+/* undoes lockPages, before memory is freed so its pages stop counting against the lock limit */
+void unlockPages(const void *memory, size_t bytes);
+
+/* clears report */
+void clearPageReport(PageReport &report);
+
+/* adds an array to report, prefaulting and locking it as asked, returns true if it locked the array */
+bool reportPages(PageReport &report, const void *memory, size_t bytes, PageMode mode, bool prefault, bool lock);
+
+/* short name of mode for reports, also the value accepted by REFERENCE_PAGES */
+const char *pageModeName(PageMode mode);
+
+#endif /* __PAGE_MEMORY__ */
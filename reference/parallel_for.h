@@ -0,0 +1,47 @@
+#pragma once
+#ifndef __PARALLEL_FOR__
+#define __PARALLEL_FOR__
+
+#include <stddef.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+/* number of hardware threads, at least 1 */
+static inline size_t hardwareThreads(void)
+{
+	unsigned n = std::thread::hardware_concurrency();
+	return (n > 0) ? (size_t)n : 1;
+}
+
+/* runs task(part) for every part in [0,parts) on up to threads threads, the calling thread being one of
+   them, and returns once all parts are done.  Parts are handed out one at a time so uneven parts balance
+   out; with a single thread (or part) everything runs in order on the calling thread. */
+template <typename Task>
+void parallelFor(size_t threads, size_t parts, const Task &task)
+{
+	if (threads > parts) threads = parts;
+	if (threads <= 1)
+	{
+		for (size_t part = 0; part < parts; part++) task(part);
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t part; (part = next++) < parts; ) task(part);
+	};
+	std::vector<std::thread> pool;
+	pool.reserve(threads - 1);
+	for (size_t t = 1; t < threads; t++) pool.push_back(std::thread(worker));
+	worker();
+	for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+}
+
+/* first index of part of count items split into parts nearly equal ranges */
+static inline size_t partStart(size_t count, size_t parts, size_t part)
+{
+	return (size_t)((unsigned long long)count * part / parts);
+}
+
+#endif /* __PARALLEL_FOR__ */
@@ -0,0 +1,147 @@
+#include "parallel_sort.h"
+#include "parallel_for.h"
+#include "rank_merge.h"
+#include <string.h>  /* for memcpy */
+#include <algorithm> /* for std::sort, std::upper_bound, std::min, std::max, std::swap */
+#include <vector>
+#include <new>       /* for std::nothrow */
+
+
+/* radix digit of Point, ranks are flipped in sign so unsigned digits order them */
+static inline size_t rankDigit(const Point &p, unsigned shift)
+{
+	return (((uint32_t)p.rank ^ 0x80000000u) >> shift) & 0xFF;
+}
+
+
+/* Copies count Points from in to out sorted by rank using a sample sort on threads threads */
+void sortByRank(const Point *in, size_t count, Point *out, size_t threads)
+{
+	if ((threads <= 1) || (count < PARALLEL_SORT_MIN))
+	{
+		if (count > 0) memcpy(out, in, count * sizeof(Point));
+		std::sort(out, out + count, PointRankLess());
+		return;
+	}
+
+	/* splitters at evenly spaced quantiles of an evenly spaced sample, bucket b takes ranks (splitters[b-1],splitters[b]] */
+	size_t buckets = threads * SORT_BUCKETS_PER_THREAD;
+	std::vector<int32_t> sample(buckets * SORT_SAMPLES_PER_BUCKET);
+	for (size_t i = 0; i < sample.size(); i++) sample[i] = in[partStart(count, sample.size(), i)].rank;
+	std::sort(sample.begin(), sample.end());
+	std::vector<int32_t> splitters(buckets - 1);
+	for (size_t b = 0; b + 1 < buckets; b++) splitters[b] = sample[(b + 1) * SORT_SAMPLES_PER_BUCKET - 1];
+
+	/* Points of each slice of in falling in each bucket */
+	size_t slices = threads;
+	std::vector<size_t> offsets(slices * buckets, 0);
+	parallelFor(threads, slices, [&](size_t slice) {
+		size_t *counts = &offsets[slice * buckets];
+		for (size_t i = partStart(count, slices, slice), end = partStart(count, slices, slice + 1); i < end; i++)
+			counts[std::upper_bound(splitters.begin(), splitters.end(), in[i].rank) - splitters.begin()]++;
+	});
+
+	/* turn counts into where each slice writes each bucket, buckets in order and slices in order within a bucket */
+	std::vector<size_t> bucketStart(buckets + 1);
+	size_t total = 0;
+	for (size_t b = 0; b < buckets; b++)
+	{
+		bucketStart[b] = total;
+		for (size_t slice = 0; slice < slices; slice++)
+		{
+			size_t n = offsets[slice * buckets + b];
+			offsets[slice * buckets + b] = total;
+			total += n;
+		}
+	}
+	bucketStart[buckets] = total;
+
+	/* scatter, the parallel copy out of in */
+	parallelFor(threads, slices, [&](size_t slice) {
+		size_t *next = &offsets[slice * buckets];
+		for (size_t i = partStart(count, slices, slice), end = partStart(count, slices, slice + 1); i < end; i++)
+			out[next[std::upper_bound(splitters.begin(), splitters.end(), in[i].rank) - splitters.begin()]++] = in[i];
+	});
+
+	/* and sort each bucket */
+	parallelFor(threads, buckets, [&](size_t b) {
+		std::sort(out + bucketStart[b], out + bucketStart[b + 1], PointRankLess());
+	});
+}
+
+/* Copies count Points from in to out sorted by rank using an LSD radix sort */
+bool radixSortByRank(const Point *in, size_t count, Point *out, size_t threads)
+{
+	size_t slices = std::max((size_t)1, std::min(threads, count / RADIX_SLICE_MIN));
+	Point *temp = new (std::nothrow) Point[count > 0 ? count : 1];
+	if (temp == NULL)
+	{
+		if (count > 0) memcpy(out, in, count * sizeof(Point));
+		return false;
+	}
+
+	/* copy in to out, counting all four digits of each slice on the way */
+	std::vector<size_t> counts(slices * 4 * 256, 0);
+	parallelFor(threads, slices, [&](size_t slice) {
+		size_t *c = &counts[slice * 4 * 256];
+		for (size_t i = partStart(count, slices, slice), end = partStart(count, slices, slice + 1); i < end; i++)
+		{
+			const Point &p = in[i];
+			out[i] = p;
+			uint32_t key = (uint32_t)p.rank ^ 0x80000000u;
+			c[key & 0xFF]++;
+			c[256 + ((key >> 8) & 0xFF)]++;
+			c[512 + ((key >> 16) & 0xFF)]++;
+			c[768 + (key >> 24)]++;
+		}
+	});
+
+	Point *src = out, *dst = temp;
+	for (unsigned digit = 0; digit < 4; digit++)
+	{
+		unsigned shift = digit * 8;
+
+		/* skip digit if every Point has the same value for it */
+		bool trivial = false;
+		for (size_t v = 0; v < 256 && !trivial; v++)
+		{
+			size_t total = 0;
+			for (size_t slice = 0; slice < slices; slice++) total += counts[(slice * 4 + digit) * 256 + v];
+			trivial = (total == count);
+		}
+		if (trivial) continue;
+
+		/* first pass counts came from in's order, later passes recount slices of the reordered array */
+		if ((digit > 0) && (slices > 1))
+		{
+			parallelFor(threads, slices, [&](size_t slice) {
+				size_t *c = &counts[(slice * 4 + digit) * 256];
+				for (size_t v = 0; v < 256; v++) c[v] = 0;
+				for (size_t i = partStart(count, slices, slice), end = partStart(count, slices, slice + 1); i < end; i++)
+					c[rankDigit(src[i], shift)]++;
+			});
+		}
+
+		/* where each slice writes each value, values in order and slices in order within a value */
+		std::vector<size_t> offsets(slices * 256);
+		size_t total = 0;
+		for (size_t v = 0; v < 256; v++)
+			for (size_t slice = 0; slice < slices; slice++)
+			{
+				offsets[slice * 256 + v] = total;
+				total += counts[(slice * 4 + digit) * 256 + v];
+			}
+
+		parallelFor(threads, slices, [&](size_t slice) {
+			size_t *next = &offsets[slice * 256];
+			for (size_t i = partStart(count, slices, slice), end = partStart(count, slices, slice + 1); i < end; i++)
+				dst[next[rankDigit(src[i], shift)]++] = src[i];
+		});
+		std::swap(src, dst);
+	}
+
+	/* odd number of passes leaves result in temp */
+	if (src != out) memcpy(out, src, count * sizeof(Point));
+	delete[] temp;
+	return true;
+}
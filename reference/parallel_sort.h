@@ -0,0 +1,68 @@
+#pragma once
+#ifndef __PARALLEL_SORT__
+#define __PARALLEL_SORT__
+
+#include <stddef.h>
+#include <vector>
+#include <algorithm> /* for std::sort, std::merge, std::copy */
+#include "point_search.h"
+#include "parallel_for.h"
+
+/* fewest Points worth sorting with more than one thread */
+#define PARALLEL_SORT_MIN 65536
+/* buckets per thread of the sample sort, more balance uneven buckets better */
+#define SORT_BUCKETS_PER_THREAD 4
+/* samples taken per bucket to choose splitters */
+#define SORT_SAMPLES_PER_BUCKET 64
+
+/* Copies count Points from in to out sorted by rank using a sample sort on threads threads.  Splitter
+   ranks are chosen from a sample, each thread counts then scatters its slice of in into rank buckets of
+   out (so the copy itself is parallel and in is read only twice), then buckets are sorted in parallel.
+   With one thread, or few Points, it is a plain copy and std::sort. */
+void sortByRank(const Point *in, size_t count, Point *out, size_t threads);
+
+/* fewest Points per thread worth splitting a radix pass across threads */
+#define RADIX_SLICE_MIN 65536
+
+/* Copies count Points from in to out sorted by rank using an LSD radix sort, 8 bits of the (sign flipped)
+   rank per pass, moving the packed Points themselves.  The copy out of in also gathers the histograms of
+   all four digits, so in is read exactly once, and digits every Point shares (high bytes of a small rank
+   range) are skipped.  Passes are split across threads in slices, each slice scattering stably to its
+   own offsets.  Needs a temporary array of count Points, returns false (out unsorted) if that fails. */
+bool radixSortByRank(const Point *in, size_t count, Point *out, size_t threads);
+
+/* Sorts count items in place by less on threads threads: each thread std::sorts a slice, then slices are
+   merged pairwise through a temporary array of count items, the pairs of each round in parallel.  Not
+   stable.  With one thread, or few items, it is a plain std::sort. */
+template <typename T, typename Less>
+void parallelSort(T *items, size_t count, const Less &less, size_t threads)
+{
+	if ((threads <= 1) || (count < PARALLEL_SORT_MIN))
+	{
+		std::sort(items, items + count, less);
+		return;
+	}
+
+	size_t slices = threads;
+	parallelFor(threads, slices, [&](size_t slice) {
+		std::sort(items + partStart(count, slices, slice), items + partStart(count, slices, slice + 1), less);
+	});
+
+	/* each round merges runs of width slices into runs of twice that, a run left without a partner is copied */
+	std::vector<T> buffer(count);
+	T *from = items, *to = &buffer[0];
+	for (size_t width = 1; width < slices; width *= 2)
+	{
+		size_t pairs = (slices + 2 * width - 1) / (2 * width);
+		parallelFor(threads, pairs, [&](size_t pair) {
+			size_t begin = partStart(count, slices, pair * 2 * width);
+			size_t mid = partStart(count, slices, std::min(slices, pair * 2 * width + width));
+			size_t end = partStart(count, slices, std::min(slices, pair * 2 * width + 2 * width));
+			std::merge(from + begin, from + mid, from + mid, from + end, to + begin, less);
+		});
+		std::swap(from, to);
+	}
+	if (from != items) std::copy(from, from + count, items);
+}
+
+#endif /* __PARALLEL_SORT__ */
@@ -0,0 +1,106 @@
+#pragma once
+#ifndef __POINT_COLUMNS__
+#define __POINT_COLUMNS__
+
+#include <stddef.h>
+#include "point_search.h"
+#include "aligned_array.h"
+#include "parallel_for.h"
+#include "index_file.h"
+
+/* Structure of arrays copy of Points: separate aligned x, y, rank and id columns.  The containment test
+   of a scan only streams the 8 bytes of x and y per Point instead of the whole packed 13 byte Point, and
+   never makes unaligned loads; rank is read only to order matches and id only when a Point is written
+   to out_points. */
+class PointColumns
+{
+public:
+	/* copy points into columns, keeping their order, on up to threads threads, each column backed by pages
+	   of at best the requested mode, returns false if out of memory */
+	bool assign(const Point *points, size_t count, size_t threads = 1, PageMode pages = PAGES_SMALL)
+	{
+		clear();
+		if (!xs.resize(count, pages) || !ys.resize(count, pages) || !ranks.resize(count, pages) || !ids.resize(count, pages))
+		{
+			clear();
+			return false;
+		}
+		size_t parts = (threads > 1) ? threads : 1;
+		parallelFor(threads, parts, [&](size_t part) {
+			for (size_t i = partStart(count, parts, part), end = partStart(count, parts, part + 1); i < end; i++)
+			{
+				xs[i] = points[i].x;
+				ys[i] = points[i].y;
+				ranks[i] = points[i].rank;
+				ids[i] = points[i].id;
+			}
+		});
+		return true;
+	}
+
+	/* reassembles Point i */
+	inline Point point(size_t i) const
+	{
+		Point p;
+		p.id = ids[i];
+		p.rank = ranks[i];
+		p.x = xs[i];
+		p.y = ys[i];
+		return p;
+	}
+
+	/* does Point i lie within specified rect? */
+	inline bool inRect(size_t i, const Rect &rect) const
+	{
+		return (xs[i] >= rect.lx) && (xs[i] <= rect.hx) && (ys[i] >= rect.ly) && (ys[i] <= rect.hy);
+	}
+
+	/* rank of Point i */
+	inline int32_t rank(size_t i) const { return ranks[i]; }
+
+	size_t size(void) const { return xs.size(); }
+	bool empty(void) const { return xs.empty(); }
+
+	/* adds columns to report, prefaulting and locking them as asked */
+	void report(PageReport &report, bool prefault, bool lock) const
+	{
+		xs.report(report, prefault, lock);
+		ys.report(report, prefault, lock);
+		ranks.report(report, prefault, lock);
+		ids.report(report, prefault, lock);
+	}
+
+	/* adds the columns to writer */
+	void save(IndexWriter &writer) const
+	{
+		writer.add(SECTION_COLUMN_X, xs);
+		writer.add(SECTION_COLUMN_Y, ys);
+		writer.add(SECTION_COLUMN_RANK, ranks);
+		writer.add(SECTION_COLUMN_ID, ids);
+	}
+
+	/* views the columns saved in file, which must stay open until cleared, returns false if file holds none */
+	bool load(const IndexFile &file)
+	{
+		bool ok = file.view(SECTION_COLUMN_X, xs) && file.view(SECTION_COLUMN_Y, ys) && file.view(SECTION_COLUMN_RANK, ranks) &&
+			file.view(SECTION_COLUMN_ID, ids) && (ys.size() == xs.size()) && (ranks.size() == xs.size()) && (ids.size() == xs.size());
+		if (!ok) clear();
+		return ok;
+	}
+
+	/* release memory */
+	void clear(void)
+	{
+		xs.clear();
+		ys.clear();
+		ranks.clear();
+		ids.clear();
+	}
+
+	AlignedArray<float> xs;
+	AlignedArray<float> ys;
+	AlignedArray<int32_t> ranks;
+	AlignedArray<int8_t> ids;
+};
+
+#endif /* __POINT_COLUMNS__ */
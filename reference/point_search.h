@@ -1,3 +1,4 @@
+#pragma once
 /* Given 10 million uniquely ranked points on a 2D plane, design a datastructure and an algorithm that can find the 20
 most important points inside any given rectangle. The solution has to be reasonably fast even in the worst case, while
 also not using an unreasonably large amount of memory.
@@ -47,3 +48,64 @@ typedef int32_t (__stdcall* T_search)(SearchContext* sc, const Rect rect, const
 
 /* Release the resources associated with the context. Return nullptr if successful, "sc" otherwise. */
 typedef SearchContext* (__stdcall* T_destroy)(SearchContext* sc);
+
+/* Optional. Search each of the "n" rects in "rects" as "search" would with "count", copying the points found in rect i
+ordered by smallest rank first to "out_points" + i * "count" and their number to "out_counts"[i]. Return the number of
+rects searched. "out_points" can hold "n" * "count" Points and "out_counts" "n" numbers. Lets a caller holding many rects
+cross into the DLL once for all of them; test applications only call it when the DLL exports it. */
+typedef int32_t (__stdcall* T_search_batch)(SearchContext* sc, const Rect* rects, const int32_t n, const int32_t count, Point* out_points,
+	int32_t* out_counts);
+
+/* Modes of the optional "count" export. */
+enum CountMode
+{
+	COUNT_ESTIMATE = 0,  /* quick estimate, constant time */
+	COUNT_EXACT = 1      /* exact number of points        */
+};
+
+/* Optional. Return the number of points inside "rect", estimated or exact as selected by "mode" (a CountMode), or -1
+if the mode is not supported. Lets a caller size a viewport before deciding whether to search it, instead of calling
+"search" with a huge "count". Test applications only call it when the DLL exports it. */
+typedef int32_t (__stdcall* T_count)(SearchContext* sc, const Rect rect, const int32_t mode);
+
+/* Optional. Write the data structures of "sc" to the file "path" in a layout "load" can map read only and search in
+place without parsing. Return non-zero if written, 0 if not (including when the context cannot be saved). */
+typedef int32_t (__stdcall* T_save)(SearchContext* sc, const char* path);
+
+/* Optional. Return a context searching the file "path" written by "save", as "create" would have for the same points,
+or nullptr if the file cannot be used. The context is released with "destroy". */
+typedef SearchContext* (__stdcall* T_load)(const char* path);
+
+/* Optional. Add "point", searchable by the next "search". Return non-zero if added, 0 if a point already has its rank
+or the DLL cannot change this context. Points are identified by their rank, which stays unique. Changes are not
+safe to make while any other call is running on the same context. */
+typedef int32_t (__stdcall* T_insert)(SearchContext* sc, const Point point);
+
+/* Optional. Remove the point ranked "rank". Return non-zero if removed, 0 if there is none or the DLL cannot change
+this context. */
+typedef int32_t (__stdcall* T_erase)(SearchContext* sc, const int32_t rank);
+
+/* Optional. Give the point ranked "rank" the rank "new_rank" instead. Return non-zero if changed, 0 if there is no
+point ranked "rank", a point already has "new_rank" or the DLL cannot change this context. */
+typedef int32_t (__stdcall* T_update_rank)(SearchContext* sc, const int32_t rank, const int32_t new_rank);
+
+/* Optional. Fold the changes made by "insert", "erase" and "update_rank" into the context's data structures so
+searches run at full speed again. Return non-zero once done. */
+typedef int32_t (__stdcall* T_compact)(SearchContext* sc);
+
+/* Counters of a DLL's cache of search results, filled by the optional "cache_stats" export. */
+struct QueryCacheStats
+{
+	uint64_t hits;          /* answered by a result cached for the same rect and count     */
+	uint64_t semanticHits;  /* answered by filtering a result cached for a containing rect */
+	uint64_t misses;        /* searched, including searches that found the cache busy      */
+	uint64_t busy;          /* skipped the cache because another thread was using it       */
+	uint64_t evictions;     /* least recently used results dropped to stay within budget   */
+	uint64_t entries;       /* results currently cached                                    */
+	uint64_t bytes;         /* bytes currently charged against the budget                  */
+	uint64_t budget;        /* most bytes the cache may use, 0 when disabled               */
+};
+
+/* Optional. Copy the counters of the search result cache of "sc" to "stats". Return true if copied, false if "sc" has
+no cache enabled. */
+typedef bool (__stdcall* T_cache_stats)(SearchContext* sc, QueryCacheStats* stats);
@@ -1,9 +1,32 @@
 #include "point_search.h"
+#include "block_index.h"
+#include "rank_merge.h"
+#include "grid_index.h"
+#include "kd_tree.h"
+#include "range_tree.h"
+#include "quad_tree.h"
+#include "wavelet_index.h"
+#include "rank_tiers.h"
+#include "point_columns.h"
+#include "filter_kernels.h"
+#include "parallel_sort.h"
+#include "search_pool.h"
+#include "query_cache.h"
+#include "query_planner.h"
+#include "index_file.h"
+#include "delta_index.h"
+#include "options.h"
+
+#include <stdio.h>   /* for printf   */
+#include <mutex>     /* for std::call_once */
+#include <memory>    /* for std::unique_ptr */
+#include <atomic>
+#include <iterator>  /* for std::back_inserter */
 
 #define USE_CPP
 #ifdef USE_CPP
 #include <vector>
-#include <algorithm> /* for std:sort */
+#include <algorithm> /* for std:sort, std::lower_bound, std::find_if, std::remove_copy_if */
 #else
 #include <string.h>  /* for memcpy   */
 #include <stdlib.h>  /* for qsort    */
@@ -11,14 +34,61 @@
 
 /* Declaration of the struct that is used as the context for the calls. */
 struct SearchContext {
+	SearchOptions options;
 	size_t count;
 #ifdef USE_CPP
 	std::vector<Point> points;
 #else
 	Point * points;
 #endif
+	/* column copy of points replacing them once built, unless the packed layout is requested */
+	PointColumns columns;
+	/* containment test used when scanning columns, picked by cpuid at create */
+	FindMatchFunc findMatch;
+	/* containment test of one Point against the rects of a batch at once, picked with findMatch */
+	FindLanesFunc findLanes;
+	/* quantized first stage of the containment test, NULL unless the blocks are quantized */
+	FindCandidateFunc findCandidate;
+	/* workers a large column search fans out to, none unless asked for at create */
+	SearchPool pool;
+	/* recent search results, reused for repeated and nested rects, disabled unless asked for at create */
+	QueryCache cache;
+	/* prefix counts and lowest ranks, answering empty and all covering rects and choosing the planner engine's index */
+	QueryPlanner planner;
+	/* bands of ranks split into spatial blocks, each with a bounding box */
+	BlockIndex blocks;
+	/* optional uniform grid engine, built only when selected */
+	GridIndex grid;
+	/* optional min-rank k-d tree engine, built only when selected */
+	KdTree kdtree;
+	/* optional range tree of Cartesian trees engine, built only when selected */
+	RangeTree rangeTree;
+	/* optional quadtree with cached top lists engine, built only when selected */
+	QuadTree quadTree;
+	/* optional succinct engine, when selected it is the only copy of the Points kept */
+	WaveletIndex wavelet;
+	/* optional rank tiers engine, when selected it holds the only copy of the Points kept */
+	RankTiers tiers;
+	/* range counting index for exact count(), built by the first exact count unless wavelet is the engine */
+	WaveletIndex counter;
+	/* a flag can not be reset, so compact() gives the rebuilt context a fresh one */
+	std::unique_ptr<std::once_flag> counterOnce;
+	/* inserts, erases and re-ranks since the indexes were built, merged into them by compact() */
+	DeltaIndex delta;
+	/* index file mapped by load(), viewed in place by columns, blocks and planner */
+	IndexFile file;
 };
 
+/* returns pointer to first of the stored Points regardless of storage used */
+static inline Point *storedPoints(SearchContext *sc)
+{
+#ifdef USE_CPP
+	return sc->points.empty() ? NULL : &sc->points[0];
+#else
+	return sc->points;
+#endif
+}
+
 /* comparison functions for sort routines resulting in a sort from smallest to largest rank */
 #ifdef USE_CPP
 bool pointsSortPredicate(const Point &a, const Point &b)
@@ -34,6 +104,54 @@ extern "C" int __cdecl pointsComparison(const void *a, const void *b)
 }
 #endif
 
+/* does p have a NaN coordinate? */
+static inline bool hasNaN(const Point &p)
+{
+	return (p.x != p.x) || (p.y != p.y);
+}
+
+/* copies and sorts by rank together into the (already sized) stored Points with the radix or sample sort */
+static void sortStoredPoints(SearchContext *sc, const Point *points_begin)
+{
+	if (sc->options.sort == SORT_RADIX)
+	{
+		/* reads input once, counting digits while copying, falls back if its temporary array can't be had */
+		if (radixSortByRank(points_begin, sc->count, storedPoints(sc), sc->options.threads)) return;
+		sc->options.sort = SORT_SAMPLE;
+	}
+	/* each thread scattering its slice of the input into rank buckets */
+	sortByRank(points_begin, sc->count, storedPoints(sc), sc->options.threads);
+}
+
+extern "C" SearchContext* __stdcall destroy(SearchContext* sc);
+static void buildContext(SearchContext *sc, const Point *points_begin, size_t count);
+static void clearContext(SearchContext *sc);
+extern "C" int32_t __stdcall compact(SearchContext* sc);
+
+/* starts the search pool and faults in the arrays of the engine, the last steps of create() and load() */
+static void startSearching(SearchContext *sc)
+{
+	/* large searches of the columns may fan out over bands once the first few bands have been scanned */
+	if ((sc->options.layout == LAYOUT_SOA) && (sc->options.searchThreads > 1))
+	{
+		sc->pool.start(sc->options.searchThreads - 1);
+		printf("[search threads: %u after %u bands] ", (unsigned)sc->options.searchThreads, (unsigned)sc->options.serialBands);
+	}
+	/* fault in (and optionally lock) the arrays searched now rather than during the first searches */
+	PageReport pages;
+	clearPageReport(pages);
+	sc->columns.report(pages, sc->options.prefault, sc->options.lock);
+	sc->blocks.report(pages, sc->options.prefault, sc->options.lock);
+	sc->wavelet.report(pages, sc->options.prefault, sc->options.lock);
+	sc->tiers.report(pages, sc->options.prefault, sc->options.lock);
+	sc->kdtree.report(pages, sc->options.prefault, sc->options.lock);
+	sc->rangeTree.report(pages, sc->options.prefault, sc->options.lock);
+	sc->quadTree.report(pages, sc->options.prefault, sc->options.lock);
+	printf("[pages: %.0fMB huge, %.0fMB transparent, %.0fMB small%s%s] ", pages.bytes[PAGES_HUGE] / 1048576.0,
+		pages.bytes[PAGES_TRANSPARENT] / 1048576.0, pages.bytes[PAGES_SMALL] / 1048576.0, pages.prefaulted ? ", prefaulted" : "",
+		pages.lockFailed ? ", lock failed" : (pages.locked ? ", locked" : ""));
+}
+
 /* Load the provided points into an internal data structure. The pointers follow the STL iterator convention, where
 "points_begin" points to the first element, and "points_end" points to one past the last element. The input points are
 only guaranteed to be valid for the duration of the call. Return a pointer to the context that can be used for
@@ -42,78 +160,557 @@ extern "C" SearchContext* __stdcall create(const Point* points_begin, const Poin
 {
 	/* create a new context */
 	SearchContext *sc = new SearchContext;
+	sc->counterOnce.reset(new std::once_flag);
+	loadSearchOptions(sc->options);
+	sc->cache.configure(sc->options.cacheBytes);
 	/* determine how many total points */
-	sc->count = (size_t)((uint8_t *)points_end - (uint8_t *)points_begin)/sizeof(Point);
+	buildContext(sc, points_begin, (size_t)((uint8_t *)points_end - (uint8_t *)points_begin)/sizeof(Point));
+	/* return our context */
+	return sc;
+}
+
+/* builds every structure of sc searching the count Points at points_begin, which need only stay valid during the call */
+static void buildContext(SearchContext *sc, const Point *points_begin, size_t count)
+{
+	/* a Point with a NaN coordinate lies in no rect, as every comparison with it fails, but it would poison the boxes,
+	   splits and bounds the engines compare rects against, so such Points are left out of all of them */
+	std::vector<Point> comparable;
+	if (std::find_if(points_begin, points_begin + count, hasNaN) != points_begin + count)
+	{
+		comparable.reserve(count);
+		std::remove_copy_if(points_begin, points_begin + count, std::back_inserter(comparable), hasNaN);
+		points_begin = comparable.empty() ? NULL : &comparable[0];
+		count = comparable.size();
+	}
+	const Point *points_end = points_begin + count;
+	sc->count = count;
+	/* every engine answers empty and all covering rects from the planner, so build it first from the caller's Points */
+	sc->planner.build(points_begin, sc->count, sc->options.plannerCells, sc->options.threads);
+	if (sc->options.engine == ENGINE_WAVELET)
+	{
+		/* succinct engine codes the Points itself, so skip the rank sorted copy entirely, or fall back to blocks if out of memory */
+#ifndef USE_CPP
+		sc->points = NULL;
+#endif
+		if (sc->wavelet.build(points_begin, sc->count, sc->options.threads))
+		{
+			/* against the packed Points (plus block boxes) the default engine keeps in its columns */
+			size_t bytes = sc->wavelet.memoryUsed();
+			printf("[wavelet matrix: %u levels, %.1fMB, %.2f bytes/point, blocks engine %u+ bytes/point] ", (unsigned)sc->wavelet.levelCount(),
+				bytes / 1048576.0, sc->count ? (double)bytes / sc->count : 0.0, (unsigned)sizeof(Point));
+			/* no columns to fan searches out over */
+			sc->options.layout = LAYOUT_AOS;
+			startSearching(sc);
+			return;
+		}
+		sc->options.engine = ENGINE_BLOCKS;
+	}
+	printf("[threads: %u] ", (unsigned)sc->options.threads);
 #ifdef USE_CPP
-	/* size our vector so won't have to reallocate memory */
-	sc->points.reserve(sc->count);
-	/* copy to our vector since no guarentee source to be valid after this call */
-	sc->points.assign(points_begin, points_end);
-	/* sort by rank, so can tranverse from lowest ranked Points to higher ones */
-	std::sort(sc->points.begin(), sc->points.end(), pointsSortPredicate);
+	if (sc->options.sort == SORT_STD)
+	{
+		/* size our vector so won't have to reallocate memory */
+		sc->points.reserve(sc->count);
+		/* copy to our vector since no guarentee source to be valid after this call */
+		sc->points.assign(points_begin, points_end);
+		/* sort by rank, so can tranverse from lowest ranked Points to higher ones */
+		std::sort(sc->points.begin(), sc->points.end(), pointsSortPredicate);
+	}
+	else
+	{
+		sc->points.resize(sc->count);
+		sortStoredPoints(sc, points_begin);
+	}
 #else
 	/* allocate big enough array to hold them all */
 	sc->points = new Point[sc->count];
-	/* copy to our array since no guarentee source to be valid after this call */
-	memcpy(sc->points, points_begin, sc->count*sizeof(Point));
-	/* sort by rank, so can tranverse from lowest ranked Points to higher ones */
-	qsort(sc->points, sc->count, sizeof(Point), pointsComparison);
+	if (sc->options.sort == SORT_STD)
+	{
+		/* copy to our array since no guarentee source to be valid after this call */
+		memcpy(sc->points, points_begin, sc->count*sizeof(Point));
+		/* sort by rank, so can tranverse from lowest ranked Points to higher ones */
+		qsort(sc->points, sc->count, sizeof(Point), pointsComparison);
+	}
+	else
+		sortStoredPoints(sc, points_begin);
 #endif
-	/* return our context */
+	/* tiers copy their slice of the rank order, so the sorted copy is no longer needed, unless out of memory for them */
+	if ((sc->options.engine == ENGINE_TIERS) && !sc->tiers.build(storedPoints(sc), sc->count, sc->options.tierPoints, sc->options.tierGrowth,
+		sc->options.kdLeafSize, sc->options.threads, sc->options.pages))
+		sc->options.engine = ENGINE_BLOCKS;
+	if (sc->options.engine == ENGINE_TIERS)
+	{
+#ifdef USE_CPP
+		std::vector<Point>().swap(sc->points);
+#else
+		delete[] sc->points;
+		sc->points = NULL;
+#endif
+		printf("[rank tiers: %u tiers, first %u Points, growth %u] ", (unsigned)sc->tiers.tierCount(),
+			(unsigned)sc->options.tierPoints, (unsigned)sc->options.tierGrowth);
+		sc->options.layout = LAYOUT_AOS;
+		startSearching(sc);
+		return;
+	}
+	/* group each band of ranks into spatially compact blocks so search can skip blocks missing rect, every engine below
+	   relies on them so if out of memory the rank sorted Points are scanned as they are */
+	if ((sc->options.engine == ENGINE_SCAN) ||
+		!sc->blocks.build(storedPoints(sc), sc->count, sc->options.blockSize, sc->options.bandBlocks, sc->options.threads))
+	{
+		sc->options.engine = ENGINE_SCAN;
+		sc->options.layout = LAYOUT_AOS;
+		printf("[scan] ");
+		startSearching(sc);
+		return;
+	}
+	/* and any additional engine requested, those out of memory leaving the blocks to search */
+	if (sc->options.engine == ENGINE_GRID)
+		sc->grid.build(storedPoints(sc), sc->count, sc->options.gridCellPoints, sc->options.threads);
+	else if ((sc->options.engine == ENGINE_KDTREE) || (sc->options.engine == ENGINE_PLANNER))
+	{
+		if (!sc->kdtree.build(storedPoints(sc), sc->count, sc->options.kdLeafSize, sc->options.threads, sc->options.pages))
+			sc->options.engine = ENGINE_BLOCKS;
+		else if (sc->options.engine == ENGINE_PLANNER)
+			printf("[planner: %ux%u cells, k-d tree past depth %u] ", (unsigned)sc->planner.prefix().cells(),
+				(unsigned)sc->planner.prefix().cells(), (unsigned)sc->options.plannerDepth);
+	}
+	else if (sc->options.engine == ENGINE_RANGE)
+	{
+		if (sc->rangeTree.build(storedPoints(sc), sc->count, sc->options.rangeLeafSize, sc->options.threads, sc->options.pages))
+		{
+			/* O(n log n) memory, so let user know what it costs */
+			size_t bytes = sc->rangeTree.memoryUsed();
+			printf("[range tree: %u levels, %.1fMB, %.1f bytes/point] ", (unsigned)sc->rangeTree.levelCount(),
+				bytes / 1048576.0, sc->count ? (double)bytes / sc->count : 0.0);
+		}
+		else
+			sc->options.engine = ENGINE_BLOCKS;
+	}
+	else if ((sc->options.engine == ENGINE_QUAD) &&
+		!sc->quadTree.build(storedPoints(sc), sc->count, sc->options.quadTopCount, sc->options.quadLeafSize,
+		sc->options.threads, sc->options.pages))
+		sc->options.engine = ENGINE_BLOCKS;
+	/* engines hold their own copies, so the blocked order can now move to columns, staying packed if out of memory */
+	if ((sc->options.layout == LAYOUT_SOA) && sc->columns.assign(storedPoints(sc), sc->count, sc->options.threads, sc->options.pages))
+	{
+		/* widest kernel the CPU supports unless overridden for benchmarking */
+		sc->options.kernel = resolveFilterKernel(sc->options.kernel);
+		sc->findMatch = findMatchFunc(sc->options.kernel);
+		sc->findLanes = findLanesFunc(sc->options.kernel);
+		/* and half the bytes per Point streamed by the first stage when quantized */
+		sc->options.quantize = sc->options.quantize && sc->blocks.quantize(sc->columns, sc->options.threads, sc->options.pages);
+		sc->findCandidate = sc->options.quantize ? findCandidateFunc(sc->options.kernel) : NULL;
+		printf("[filter: %s%s] ", filterKernelName(sc->options.kernel), sc->options.quantize ? ", quantized" : "");
+#ifdef USE_CPP
+		std::vector<Point>().swap(sc->points);
+#else
+		delete[] sc->points;
+		sc->points = NULL;
+#endif
+	}
+	else
+		sc->options.layout = LAYOUT_AOS;
+	startSearching(sc);
+}
+
+/* Write the index of "sc" to "path" so load() can map it later.  Return non-zero if written, 0 if it could not be
+written, the context's engine and layout are not the ones saved (the default blocks over columns) or it has changes
+not yet compacted. */
+extern "C" int32_t __stdcall save(SearchContext* sc, const char* path)
+{
+	if ((sc == NULL) || (path == NULL) || (sc->options.engine != ENGINE_BLOCKS) || (sc->options.layout != LAYOUT_SOA) || !sc->delta.empty())
+		return 0;
+	IndexWriter writer;
+	sc->columns.save(writer);
+	sc->blocks.save(writer);
+	sc->planner.save(writer);
+	return writer.write(path) ? 1 : 0;
+}
+
+/* Map the index saved to "path" read only and return a context searching it in place, as create() would have
+returned for the same Points; nullptr if "path" is not an index file this plugin can use. */
+extern "C" SearchContext* __stdcall load(const char* path)
+{
+	SearchContext *sc = new SearchContext;
+	sc->counterOnce.reset(new std::once_flag);
+	loadSearchOptions(sc->options);
+	/* the file holds the default engine over columns, whatever else the options ask for */
+	sc->options.engine = ENGINE_BLOCKS;
+	sc->options.layout = LAYOUT_SOA;
+#ifndef USE_CPP
+	sc->points = NULL;
+#endif
+	if ((path == NULL) || !sc->file.open(path) || !sc->columns.load(sc->file) || !sc->blocks.load(sc->file) || !sc->planner.load(sc->file) ||
+		(sc->blocks.size() != sc->columns.size()) || (sc->planner.prefix().total() != sc->columns.size()))
+	{
+		destroy(sc);
+		return nullptr;
+	}
+	sc->count = sc->columns.size();
+	sc->cache.configure(sc->options.cacheBytes);
+	sc->options.kernel = resolveFilterKernel(sc->options.kernel);
+	sc->findMatch = findMatchFunc(sc->options.kernel);
+	sc->findLanes = findLanesFunc(sc->options.kernel);
+	/* the quantized first stage is only there if the saving context had it */
+	sc->options.quantize = sc->options.quantize && sc->blocks.quantized();
+	sc->findCandidate = sc->options.quantize ? findCandidateFunc(sc->options.kernel) : NULL;
+	printf("[mapped: %.1fMB] [filter: %s%s] ", sc->file.size() / 1048576.0, filterKernelName(sc->options.kernel),
+		sc->options.quantize ? ", quantized" : "");
+	startSearching(sc);
 	return sc;
 }
 
 
 
+/* tests the count Points at points, sorted by rank, in order until maximum matches of rect are found */
+static int32_t scanPoints(const Point *points, size_t count, const Rect &rect, const int32_t maximum, Point *out_points)
+{
+	int32_t matches = 0;
+	for (const Point *p = points, *pEnd = points + count; (p < pEnd) && (matches < maximum); ++p)
+		if (inRect(*p, rect)) out_points[matches++] = *p;
+	return matches;
+}
+
+/* runs search on the selected engine, plan being the planner's choice for it */
+static int32_t searchEngines(SearchContext* sc, const Rect &rect, const int32_t count, Point* out_points, SearchPlan plan)
+{
+	if (sc->options.engine == ENGINE_PLANNER)
+	{
+		/* rare matches descend the k-d tree, common ones walk the blocks below */
+		if (plan == PLAN_SPATIAL) return sc->kdtree.search(rect, count, out_points);
+	}
+	else if (sc->options.engine == ENGINE_SCAN)
+	{
+		/* no blocks, every Point in rank order until count match */
+		return scanPoints(storedPoints(sc), sc->count, rect, count, out_points);
+	}
+	else if (sc->options.engine == ENGINE_WAVELET)
+	{
+		/* wavelet nodes best first by lower bound on rank */
+		return sc->wavelet.search(rect, count, out_points);
+	}
+	else if (sc->options.engine == ENGINE_TIERS)
+	{
+		/* lowest ranked tiers first, stopping once count matches found */
+		return sc->tiers.search(rect, count, out_points);
+	}
+	else if (sc->options.engine == ENGINE_GRID)
+	{
+		/* merge cells around rect, unless so many cells overlap that a scan is the better choice */
+		int32_t matches = sc->grid.search(rect, count, out_points, sc->options.gridMergeCells);
+		if (matches >= 0) return matches;
+	}
+	else if (sc->options.engine == ENGINE_KDTREE)
+	{
+		/* best first descent by lowest rank in subtree */
+		return sc->kdtree.search(rect, count, out_points);
+	}
+	else if (sc->options.engine == ENGINE_RANGE)
+	{
+		/* canonical x nodes, then Cartesian tree roots in rank order */
+		return sc->rangeTree.search(rect, count, out_points);
+	}
+	else if (sc->options.engine == ENGINE_QUAD)
+	{
+		/* cached lists of covered nodes, opening only border nodes */
+		return sc->quadTree.search(rect, count, out_points);
+	}
+	/* walk bands in rank order, skipping any block whose bounding box misses rect */
+	if ((sc->options.layout == LAYOUT_SOA) && (sc->pool.size() > 0))
+		return sc->blocks.searchParallel(sc->columns, rect, count, out_points, sc->findMatch, sc->findCandidate, sc->pool, sc->options.serialBands);
+	if (sc->options.layout == LAYOUT_SOA)
+		return sc->blocks.search(sc->columns, rect, count, out_points, sc->findMatch, sc->findCandidate);
+	return sc->blocks.search(storedPoints(sc), rect, count, out_points);
+}
+
+/* runs search on the selected engine over the Points as changed since it was built, plan being the planner's choice for it */
+static int32_t searchChanged(SearchContext* sc, const Rect &rect, const int32_t count, Point* out_points, SearchPlan plan)
+{
+	if (sc->delta.empty()) return searchEngines(sc, rect, count, out_points, plan);
+	/* the engine, asked for more Points to make up for tombstones, planned again for that many */
+	return sc->delta.search(rect, count, out_points, [sc, &rect](int32_t wanted, Point *found) {
+		SearchPlan plan = sc->planner.plan(rect, wanted, sc->options.plannerDepth);
+		if (plan == PLAN_EMPTY) return 0;
+		if (plan == PLAN_TOP) return sc->planner.top(wanted, found);
+		return searchEngines(sc, rect, wanted, found, plan);
+	});
+}
+
 /* Search for "count" points with the smallest ranks inside "rect" and copy them ordered by smallest rank first in
 "out_points". Return the number of points copied. "out_points" points to a buffer owned by the caller that
-can hold "count" number of Points. */
+can hold "count" number of Points.
+Every engine is read only once create() returns and keeps any scratch per thread, so any number of threads may
+search one context at once without waiting on each other.  The only shared state written is the optional pool,
+which a search claims with a single atomic exchange or else runs on its own thread, and the optional query cache,
+which a search skips when another thread holds it.  Changes (insert, erase, update_rank, compact) must not overlap
+any other call on the context. */
 extern "C" int32_t __stdcall search(SearchContext* sc, const Rect rect, const int32_t count, Point* out_points)
 {
-	/* keep track of matches found, initially none */
-	int32_t matches = 0;
-	/* search for first count matches */
-#if 0
-	/* valid for both vector or array sc->points, but slower */
-	for (size_t i = 0; i < sc->count; i++)
+	/* nothing to find, or everything matches so the lowest ranks are the answer */
+	SearchPlan plan = sc->planner.plan(rect, count, sc->options.plannerDepth);
+	if (sc->delta.empty())
+	{
+		if (plan == PLAN_EMPTY) return 0;
+		if (plan == PLAN_TOP) return sc->planner.top(count, out_points);
+	}
+	if (!sc->cache.enabled()) return searchChanged(sc, rect, count, out_points, plan);
+
+	/* answer from a cached result of this or a containing rect, else search and cache the result */
+	int32_t matches = sc->cache.lookup(rect, count, out_points);
+	if (matches >= 0) return matches;
+	matches = searchChanged(sc, rect, count, out_points, plan);
+	sc->cache.insert(rect, count, out_points, matches);
+	return matches;
+}
+
+/* Z order of the center of rect within box at 16 bits per axis, so rects near one another sort together */
+static uint32_t localityKey(const Rect &rect, const Rect &box)
+{
+	float sx = (box.hx > box.lx) ? 65535.0f / (box.hx - box.lx) : 0.0f, sy = (box.hy > box.ly) ? 65535.0f / (box.hy - box.ly) : 0.0f;
+	float fx = ((rect.lx + rect.hx) * 0.5f - box.lx) * sx, fy = ((rect.ly + rect.hy) * 0.5f - box.ly) * sy;
+	uint32_t x = (fx > 0.0f) ? ((fx < 65535.0f) ? (uint32_t)fx : 65535u) : 0u;
+	uint32_t y = (fy > 0.0f) ? ((fy < 65535.0f) ? (uint32_t)fy : 65535u) : 0u;
+	uint32_t key = 0;
+	for (unsigned bit = 0; bit < 16; bit++) key |= (((x >> bit) & 1u) << (2 * bit)) | (((y >> bit) & 1u) << (2 * bit + 1));
+	return key;
+}
+
+/* Search each of the "n" rects in "rects" as search() would, results of rect i going to "out_points" + i * "count" and
+their number to "out_counts"[i].  Return the number of rects searched.
+Over the default engine and layout, rects the planner cannot answer alone and not expected to be done within the first
+batchBands bands are sorted by where they lie and searched BATCH_LANES at a time, each group reading the blocks
+overlapping it once and testing each Point against all its rects with one compare; groups fan out over the search pool
+if there is one.  Rects expected to be done sooner are searched alone, as are all rects of other engines, contexts with
+changes and contexts with the query cache enabled. */
+extern "C" int32_t __stdcall search_batch(SearchContext* sc, const Rect* rects, const int32_t n, const int32_t count, Point* out_points, int32_t* out_counts)
+{
+	if ((sc == NULL) || (rects == NULL) || (out_counts == NULL) || (n <= 0)) return 0;
+	if ((count <= 0) || (out_points == NULL))
 	{
-		/* next Point */
-		const Point &p = sc->points[i];
-#elif defined USE_CPP
-	for (std::vector<Point>::const_iterator c_iter = sc->points.begin(); c_iter != sc->points.end(); ++c_iter)
+		for (int32_t i = 0; i < n; i++) out_counts[i] = 0;
+		return n;
+	}
+	if ((sc->options.engine != ENGINE_BLOCKS) || (sc->options.layout != LAYOUT_SOA) || !sc->delta.empty() || sc->cache.enabled())
 	{
-		/* next Point */
-		const Point &p = (*c_iter);
-#else
-	for (const Point *pCur = sc->points, *pEnd = sc->points+sc->count; pCur < pEnd; ++pCur)
+		for (int32_t i = 0; i < n; i++) out_counts[i] = search(sc, rects[i], count, out_points + (size_t)i * count);
+		return n;
+	}
+
+	/* empty and all covering rects need no pass over the data, and rects expected to be done within the first few bands
+	   share too few blocks with others to make up for the lanes, so those are searched alone; the rest are ordered for locality */
+	std::vector<std::pair<uint32_t, int32_t> > keyed;
+	keyed.reserve(n);
+	double aloneDepth = (double)sc->options.batchBands * (double)sc->blocks.bandSize();
+	for (int32_t i = 0; i < n; i++)
 	{
-		/* next Point */
-		const Point &p = *pCur;
-#endif
-		/* does current Point lie within specified rect? */
-		if ((p.x >= rect.lx) && (p.x <= rect.hx) && (p.y >= rect.ly) && (p.y <= rect.hy))
+		SearchPlan plan = sc->planner.plan(rects[i], count, sc->options.plannerDepth);
+		Point *out = out_points + (size_t)i * count;
+		if (plan == PLAN_EMPTY) out_counts[i] = 0;
+		else if (plan == PLAN_TOP) out_counts[i] = sc->planner.top(count, out);
+		else if (sc->planner.depth(rects[i], count) <= aloneDepth) out_counts[i] = searchEngines(sc, rects[i], count, out, plan);
+		else keyed.push_back(std::make_pair(localityKey(rects[i], sc->planner.prefix().bounds()), i));
+	}
+	std::sort(keyed.begin(), keyed.end());
+	std::vector<int32_t> queries(keyed.size());
+	for (size_t q = 0; q < keyed.size(); q++) queries[q] = keyed[q].second;
+
+	/* consecutive groups of lanes per part, several parts per thread so early finishers pick up more */
+	size_t groups = (queries.size() + BATCH_LANES - 1) / BATCH_LANES;
+	if ((sc->pool.size() > 0) && (groups > 1))
+	{
+		size_t parts = std::min(groups, (sc->pool.size() + 1) * PARALLEL_SEGMENTS_PER_THREAD);
+		std::function<void(size_t)> task = [&](size_t part) {
+			size_t begin = partStart(groups, parts, part) * BATCH_LANES, end = std::min(partStart(groups, parts, part + 1) * BATCH_LANES, queries.size());
+			sc->blocks.searchBatch(sc->columns, rects, &queries[begin], end - begin, count, out_points, out_counts, sc->findLanes);
+		};
+		if (sc->pool.run(parts, task)) return n;
+	}
+	if (!queries.empty()) sc->blocks.searchBatch(sc->columns, rects, &queries[0], queries.size(), count, out_points, out_counts, sc->findLanes);
+	return n;
+}
+
+/* Copy the counters of the search result cache of "sc" to "stats". Return true if copied, false if "sc" has no cache
+enabled. */
+extern "C" bool __stdcall cache_stats(SearchContext* sc, QueryCacheStats* stats)
+{
+	if ((sc == NULL) || (stats == NULL) || !sc->cache.enabled()) return false;
+	sc->cache.stats(*stats);
+	return true;
+}
+
+/* wavelet matrix answering exact counts, either the search engine or one built from the stored Points on first use */
+static const WaveletIndex &countingIndex(SearchContext* sc)
+{
+	if (sc->options.engine == ENGINE_WAVELET) return sc->wavelet;
+	std::call_once(*sc->counterOnce, [sc]() {
+		if (sc->options.engine == ENGINE_TIERS)
+		{
+			std::vector<Point> points;
+			points.reserve(sc->count);
+			sc->tiers.copyPoints(points);
+			sc->counter.build(points.empty() ? NULL : &points[0], points.size(), sc->options.threads);
+		}
+		else if (sc->options.layout == LAYOUT_SOA)
+		{
+			std::vector<Point> points(sc->count);
+			for (size_t i = 0; i < sc->count; i++) points[i] = sc->columns.point(i);
+			sc->counter.build(points.empty() ? NULL : &points[0], points.size(), sc->options.threads);
+		}
+		else
+			sc->counter.build(storedPoints(sc), sc->count, sc->options.threads);
+	});
+	return sc->counter;
+}
+
+/* number of Points of the indexes as built inside rect (not inverted), estimated or exact as selected by mode */
+static int64_t countBuilt(SearchContext* sc, const Rect &rect, const int32_t mode)
+{
+	/* nothing inside, or everything inside, is known exactly from the prefix grid alone */
+	const PrefixGrid &prefix = sc->planner.prefix();
+	if (prefix.upperBound(rect) == 0) return 0;
+	const Rect &box = prefix.bounds();
+	if ((rect.lx <= box.lx) && (rect.ly <= box.ly) && (rect.hx >= box.hx) && (rect.hy >= box.hy)) return (int64_t)prefix.total();
+
+	if (mode == COUNT_ESTIMATE) return (int64_t)std::min(prefix.estimate(rect) + 0.5, (double)prefix.upperBound(rect));
+	return (int64_t)countingIndex(sc).countIn(rect);
+}
+
+/* Return the number of points inside "rect", estimated or exact as selected by "mode" (a CountMode), or -1
+if the mode is not supported. */
+extern "C" int32_t __stdcall count(SearchContext* sc, const Rect rect, const int32_t mode)
+{
+	if ((mode != COUNT_ESTIMATE) && (mode != COUNT_EXACT)) return -1;
+	if (!(rect.lx <= rect.hx) || !(rect.ly <= rect.hy)) return 0;
+	/* changes since the build are counted exactly in either mode */
+	int64_t points = countBuilt(sc, rect, mode) + sc->delta.countChange(rect);
+	return (int32_t)std::max((int64_t)0, points);
+}
+
+/* can sc take changes?  Engines keeping no rank ordered blocks have no way to find a Point by rank */
+static bool changeable(SearchContext* sc)
+{
+	return (sc != NULL) && (sc->options.engine != ENGINE_WAVELET) && (sc->options.engine != ENGINE_TIERS);
+}
+
+/* finds the Point ranked rank in the indexes as built, through the rank ordered blocks or the scanned rank order */
+static DeltaIndex::MainLookup builtLookup(SearchContext* sc)
+{
+	return [sc](int32_t rank, Point &point) {
+		if (sc->options.engine == ENGINE_SCAN)
 		{
-			/* yes, so add to ones returned */
-			out_points[matches] = p;
-			/* update how many we have found so far */
-			matches++;
-			/* and if we hit the limit prior to going through all possible Points, exit early */
-			if (matches >= count) break;
+			const Point *points = storedPoints(sc), *p = std::lower_bound(points, points + sc->count, rank,
+				[](const Point &a, int32_t r) { return a.rank < r; });
+			if ((p == points + sc->count) || (p->rank != rank)) return false;
+			point = *p;
+			return true;
 		}
+		if (sc->options.layout == LAYOUT_SOA)
+		{
+			size_t i = sc->blocks.find(sc->columns, rank);
+			if (i >= sc->count) return false;
+			point = sc->columns.point(i);
+			return true;
+		}
+		size_t i = sc->blocks.find(storedPoints(sc), rank);
+		if (i >= sc->count) return false;
+		point = storedPoints(sc)[i];
+		return true;
+	};
+}
+
+/* drops results cached before a change, and compacts once changes reach the configured limit */
+static void changed(SearchContext* sc)
+{
+	sc->cache.clear();
+	if ((sc->options.compactPoints > 0) && (sc->delta.size() >= sc->options.compactPoints)) compact(sc);
+}
+
+/* Add "point", searchable at once.  Return non-zero if added, 0 if a point already has its rank or the context
+cannot be changed. */
+extern "C" int32_t __stdcall insert(SearchContext* sc, const Point point)
+{
+	if (!changeable(sc) || !sc->delta.insert(point, builtLookup(sc))) return 0;
+	changed(sc);
+	return 1;
+}
+
+/* Remove the point ranked "rank".  Return non-zero if removed, 0 if there is none or the context cannot be changed. */
+extern "C" int32_t __stdcall erase(SearchContext* sc, const int32_t rank)
+{
+	if (!changeable(sc) || !sc->delta.erase(rank, builtLookup(sc))) return 0;
+	changed(sc);
+	return 1;
+}
+
+/* Give the point ranked "rank" the rank "new_rank" instead.  Return non-zero if changed, 0 if there is no point
+ranked "rank", a point already has "new_rank" or the context cannot be changed. */
+extern "C" int32_t __stdcall update_rank(SearchContext* sc, const int32_t rank, const int32_t new_rank)
+{
+	if (!changeable(sc) || !sc->delta.updateRank(rank, new_rank, builtLookup(sc))) return 0;
+	changed(sc);
+	return 1;
+}
+
+/* Rebuild the context with all changes merged in, so searches no longer pay for them.  Return non-zero once done. */
+extern "C" int32_t __stdcall compact(SearchContext* sc)
+{
+	if (sc == NULL) return 0;
+	if (sc->delta.empty()) return 1;
+
+	/* live Points are those built less the tombstoned, plus those inserted */
+	std::vector<Point> live;
+	live.reserve(sc->count - sc->delta.removedCount() + sc->delta.addedCount());
+	for (size_t i = 0; i < sc->count; i++)
+	{
+		Point p = (sc->options.layout == LAYOUT_SOA) ? sc->columns.point(i) : storedPoints(sc)[i];
+		if (!sc->delta.removes(p.rank)) live.push_back(p);
 	}
-	return matches;
+	live.insert(live.end(), sc->delta.insertedPoints().begin(), sc->delta.insertedPoints().end());
+
+	/* then rebuild from them as create() does, which also leaves any mapped file behind */
+	clearContext(sc);
+	buildContext(sc, live.empty() ? NULL : &live[0], live.size());
+	return 1;
 }
 
 /* Release the resources associated with the context. Return nullptr if successful, "sc" otherwise. */
 extern "C" SearchContext* __stdcall destroy(SearchContext* sc)
 {
-	/* free allocated memory */
+	/* report how well the cache earned its memory */
+	QueryCacheStats stats;
+	if (cache_stats(sc, &stats))
+		printf("[cache: %llu hits, %llu contained, %llu misses (%llu busy), %llu evictions, %llu entries, %.1fMB of %.1fMB] ",
+			(unsigned long long)stats.hits, (unsigned long long)stats.semanticHits, (unsigned long long)stats.misses,
+			(unsigned long long)stats.busy, (unsigned long long)stats.evictions, (unsigned long long)stats.entries,
+			stats.bytes / 1048576.0, stats.budget / 1048576.0);
+	clearContext(sc);
+	delete sc;
+	return nullptr;
+}
+
+/* stops search workers then frees every structure and change of sc, leaving its options */
+static void clearContext(SearchContext* sc)
+{
+	sc->pool.stop();
+	sc->blocks.clear();
+	sc->columns.clear();
+	sc->grid.clear();
+	sc->kdtree.clear();
+	sc->rangeTree.clear();
+	sc->quadTree.clear();
+	sc->wavelet.clear();
+	sc->tiers.clear();
+	sc->cache.clear();
+	sc->planner.clear();
+	sc->counter.clear();
+	sc->counterOnce.reset(new std::once_flag);
+	sc->delta.clear();
+	/* only once nothing views it */
+	sc->file.close();
 #ifdef USE_CPP
-	sc->points.clear();
-	sc->points.swap(sc->points);
+	std::vector<Point>().swap(sc->points);
 #else
 	delete[] sc->points;
+	sc->points = NULL;
 #endif
-	delete sc;
-	return nullptr;
 }
@@ -0,0 +1,164 @@
+#include "prefix_grid.h"
+#include "parallel_for.h"
+#include <algorithm> /* for std::min, std::max */
+#include <string.h>  /* for memset */
+
+/* fewest Points counted by each thread, smaller inputs use fewer threads */
+#define PREFIX_PART_MIN 65536
+
+
+PrefixGrid::PrefixGrid(void)
+{
+	count = dim = 0;
+	box.lx = box.ly = box.hx = box.hy = 0.0f;
+	scaleX = scaleY = 0.0;
+}
+
+/* cell column (or row) containing coordinate v, low and scale describe that axis; monotonic in v
+   so every Point within [lo,hi] lies in a cell between cellOf(lo) and cellOf(hi) */
+inline size_t PrefixGrid::cellOf(float v, float low, double scale) const
+{
+	double f = ((double)v - (double)low) * scale;
+	if (!(f > 0.0)) return 0;
+	if (f >= (double)dim) return dim - 1;
+	return (size_t)f;
+}
+
+/* Points in cells [cx0,cx1) x [cy0,cy1) */
+inline size_t PrefixGrid::sum(size_t cx0, size_t cy0, size_t cx1, size_t cy1) const
+{
+	size_t stride = dim + 1;
+	return (size_t)sums[cy1 * stride + cx1] - sums[cy0 * stride + cx1] - sums[cy1 * stride + cx0] + sums[cy0 * stride + cx0];
+}
+
+/* count points (any order) into cells per side cells, using up to threads threads */
+void PrefixGrid::build(const Point *points, size_t count, size_t cells, size_t threads)
+{
+	clear();
+	if (count == 0) return;
+	this->count = count;
+	dim = std::min(std::max(cells, (size_t)1), (size_t)MAX_PREFIX_CELLS);
+	size_t parts = std::max((size_t)1, std::min(threads, count / PREFIX_PART_MIN));
+
+	/* bounds of data, each part finds its own then they are combined */
+	std::vector<Rect> partBox(parts);
+	parallelFor(threads, parts, [&](size_t part) {
+		const Point *p = points + partStart(count, parts, part), *pEnd = points + partStart(count, parts, part + 1);
+		Rect b = { p->x, p->y, p->x, p->y };
+		for (; p < pEnd; ++p)
+		{
+			if (p->x < b.lx) b.lx = p->x;
+			if (p->x > b.hx) b.hx = p->x;
+			if (p->y < b.ly) b.ly = p->y;
+			if (p->y > b.hy) b.hy = p->y;
+		}
+		partBox[part] = b;
+	});
+	box = partBox[0];
+	for (size_t part = 1; part < parts; part++)
+	{
+		box.lx = std::min(box.lx, partBox[part].lx);
+		box.ly = std::min(box.ly, partBox[part].ly);
+		box.hx = std::max(box.hx, partBox[part].hx);
+		box.hy = std::max(box.hy, partBox[part].hy);
+	}
+	scaleX = (box.hx > box.lx) ? (double)dim / ((double)box.hx - (double)box.lx) : 0.0;
+	scaleY = (box.hy > box.ly) ? (double)dim / ((double)box.hy - (double)box.ly) : 0.0;
+
+	/* each part counts its Points per cell, then the counts are summed into the table */
+	std::vector<std::vector<uint32_t> > partCounts(parts);
+	parallelFor(threads, parts, [&](size_t part) {
+		std::vector<uint32_t> &cellCounts = partCounts[part];
+		cellCounts.assign(dim * dim, 0);
+		for (const Point *p = points + partStart(count, parts, part), *pEnd = points + partStart(count, parts, part + 1); p < pEnd; ++p)
+			cellCounts[cellOf(p->y, box.ly, scaleY) * dim + cellOf(p->x, box.lx, scaleX)]++;
+	});
+	size_t stride = dim + 1;
+	if (!sums.resize(stride * stride))
+	{
+		clear();
+		return;
+	}
+	memset(sums.data(), 0, stride * stride * sizeof(uint32_t));
+	for (size_t cy = 0; cy < dim; cy++)
+	{
+		uint32_t row = 0;
+		for (size_t cx = 0; cx < dim; cx++)
+		{
+			for (size_t part = 0; part < parts; part++) row += partCounts[part][cy * dim + cx];
+			sums[(cy + 1) * stride + cx + 1] = sums[cy * stride + cx + 1] + row;
+		}
+	}
+}
+
+/* table interpolated at fractional cell position (u,v), both clamped to [0,dim] */
+double PrefixGrid::at(double u, double v) const
+{
+	size_t cx = std::min((size_t)u, dim - 1), cy = std::min((size_t)v, dim - 1);
+	double fx = u - (double)cx, fy = v - (double)cy;
+	size_t stride = dim + 1;
+	const uint32_t *low = &sums[cy * stride + cx], *high = low + stride;
+	return (1.0 - fy) * ((1.0 - fx) * low[0] + fx * low[1]) + fy * ((1.0 - fx) * high[0] + fx * high[1]);
+}
+
+/* expected number of Points inside rect, rect must not be inverted */
+double PrefixGrid::estimate(const Rect &rect) const
+{
+	if (count == 0) return 0.0;
+
+	/* fractional cell positions of the edges; a low edge on the data bounds keeps Points on it, as does a high edge */
+	double full = (double)dim;
+	double u0 = !(rect.lx > box.lx) ? 0.0 : ((rect.lx > box.hx) ? full : std::min(full, ((double)rect.lx - box.lx) * scaleX));
+	double v0 = !(rect.ly > box.ly) ? 0.0 : ((rect.ly > box.hy) ? full : std::min(full, ((double)rect.ly - box.ly) * scaleY));
+	double u1 = !(rect.hx < box.hx) ? full : ((rect.hx < box.lx) ? 0.0 : std::min(full, ((double)rect.hx - box.lx) * scaleX));
+	double v1 = !(rect.hy < box.hy) ? full : ((rect.hy < box.ly) ? 0.0 : std::min(full, ((double)rect.hy - box.ly) * scaleY));
+	if ((u1 <= u0) || (v1 <= v0)) return 0.0;
+
+	double n = at(u1, v1) - at(u0, v1) - at(u1, v0) + at(u0, v0);
+	return (n > 0.0) ? n : 0.0;
+}
+
+/* number of Points in the cells rect touches, 0 proves rect holds no Point; rect must not be inverted */
+size_t PrefixGrid::upperBound(const Rect &rect) const
+{
+	if (count == 0) return 0;
+	if ((rect.hx < box.lx) || (rect.lx > box.hx) || (rect.hy < box.ly) || (rect.ly > box.hy)) return 0;
+	size_t cx0 = cellOf(rect.lx, box.lx, scaleX), cx1 = cellOf(rect.hx, box.lx, scaleX);
+	size_t cy0 = cellOf(rect.ly, box.ly, scaleY), cy1 = cellOf(rect.hy, box.ly, scaleY);
+	return sum(cx0, cy0, cx1 + 1, cy1 + 1);
+}
+
+/* release memory used by the table */
+void PrefixGrid::clear(void)
+{
+	count = dim = 0;
+	sums.clear();
+}
+
+/* adds the table's sections to writer */
+void PrefixGrid::save(IndexWriter &writer) const
+{
+	PrefixGridMeta meta = { count, dim, box, scaleX, scaleY };
+	writer.addValue(SECTION_PREFIX_META, meta);
+	writer.add(SECTION_PREFIX_SUMS, sums);
+}
+
+/* views the table saved in file, which must stay open until cleared, returns false if file holds none */
+bool PrefixGrid::load(const IndexFile &file)
+{
+	clear();
+	size_t metas;
+	const PrefixGridMeta *meta = (const PrefixGridMeta *)file.section(SECTION_PREFIX_META, sizeof(PrefixGridMeta), metas);
+	if ((meta == NULL) || (metas != 1) || !file.view(SECTION_PREFIX_SUMS, sums)) return false;
+	count = (size_t)meta->count;
+	dim = (size_t)meta->dim;
+	box = meta->box;
+	scaleX = meta->scaleX;
+	scaleY = meta->scaleY;
+	if ((count > 0) && ((dim == 0) || (dim > MAX_PREFIX_CELLS) || (sums.size() != (dim + 1) * (dim + 1))))
+	{
+		clear();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#ifndef __PREFIX_GRID__
+#define __PREFIX_GRID__
+
+#include <stddef.h>
+#include <vector>
+#include "point_search.h"
+#include "aligned_array.h"
+#include "index_file.h"
+
+/* default cells per side of the prefix count grid */
+#define DEFAULT_PREFIX_CELLS 256
+/* upper limit on cells per side of the prefix count grid */
+#define MAX_PREFIX_CELLS 4096
+
+/* scalars of a PrefixGrid as saved in an index file */
+struct PrefixGridMeta {
+	uint64_t count;
+	uint64_t dim;
+	Rect box;
+	double scaleX, scaleY;
+};
+
+/* Summed-area table over a C x C uniform grid spanning the bounds of the data: entry (x,y) holds the
+   number of Points in all cells left of column x and below row y, so the Points of any range of cells
+   are counted with four lookups.  Counts for an arbitrary rect are estimated by interpolating the
+   table between cell corners, i.e. assuming Points are spread evenly within each cell, while the
+   cells touched by a rect bound its count from above exactly. */
+class PrefixGrid
+{
+public:
+	PrefixGrid(void);
+
+	/* count points (any order) into cells per side cells, using up to threads threads */
+	void build(const Point *points, size_t count, size_t cells = DEFAULT_PREFIX_CELLS, size_t threads = 1);
+
+	/* expected number of Points inside rect, rect must not be inverted */
+	double estimate(const Rect &rect) const;
+
+	/* number of Points in the cells rect touches, 0 proves rect holds no Point; rect must not be inverted */
+	size_t upperBound(const Rect &rect) const;
+
+	/* smallest rect holding every Point, meaningless when empty */
+	const Rect &bounds(void) const { return box; }
+
+	/* total Points counted */
+	size_t total(void) const { return count; }
+
+	/* cells per side */
+	size_t cells(void) const { return dim; }
+
+	/* bytes of memory used by the table */
+	size_t memoryUsed(void) const { return sums.size() * sizeof(uint32_t); }
+
+	/* adds the table's sections to writer */
+	void save(IndexWriter &writer) const;
+
+	/* views the table saved in file, which must stay open until cleared, returns false if file holds none */
+	bool load(const IndexFile &file);
+
+	/* release memory used by the table */
+	void clear(void);
+
+private:
+	/* cell column (or row) containing coordinate v, low and scale describe that axis */
+	inline size_t cellOf(float v, float low, double scale) const;
+
+	/* Points in cells [cx0,cx1) x [cy0,cy1) */
+	inline size_t sum(size_t cx0, size_t cy0, size_t cx1, size_t cy1) const;
+
+	/* table interpolated at fractional cell position (u,v), both clamped to [0,dim] */
+	double at(double u, double v) const;
+
+	size_t count;                  /* total Points                                       */
+	size_t dim;                    /* C, cells per side                                  */
+	Rect box;                      /* bounds of data                                     */
+	double scaleX, scaleY;         /* cells per unit of x and y                          */
+	AlignedArray<uint32_t> sums;   /* (C+1) x (C+1) table, row major, first row/column 0 */
+};
+
+#endif /* __PREFIX_GRID__ */
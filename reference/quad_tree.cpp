@@ -0,0 +1,276 @@
+#include "quad_tree.h"
+#include "rank_merge.h"
+#include "parallel_for.h"
+#include <algorithm> /* for std::partition, std::sort, heap functions */
+
+
+/* partition predicates splitting Points of a node into quadrants */
+struct QuadLeftOf {
+	float x;
+	bool operator()(const Point &p) const { return p.x < x; }
+};
+struct QuadBelow {
+	float y;
+	bool operator()(const Point &p) const { return p.y < y; }
+};
+
+/* orders positions of Points by rank */
+struct QuadRankLess {
+	const Point *points;
+	bool operator()(uint32_t a, uint32_t b) const { return points[a].rank < points[b].rank; }
+};
+
+/* node waiting to be visited, ordered so the lowest minRank is visited first */
+struct QuadVisit {
+	int32_t minRank;
+	uint32_t node;
+	bool operator<(const QuadVisit &other) const { return minRank > other.minRank; }
+};
+
+
+QuadTree::QuadTree(void)
+{
+	topCount = DEFAULT_QUAD_TOP_COUNT;
+	leafSize = DEFAULT_QUAD_LEAF_SIZE;
+}
+
+/* recursively build node (already allocated in nodeList) over points [begin,end) within region, appending
+   children to nodeList and top lists to topList, which are copied to nodes and tops once complete; when
+   deferred is given subtrees at deferDepth are appended to it instead and no top lists are gathered */
+void QuadTree::split(std::vector<QuadNode> &nodeList, std::vector<uint32_t> &topList, uint32_t index, size_t begin, size_t end, BlockBox region, size_t depth,
+	std::vector<QuadSubtree> *deferred, size_t deferDepth)
+{
+	if ((deferred != NULL) && (depth == deferDepth))
+	{
+		QuadSubtree subtree = { index, begin, end, region, depth };
+		deferred->push_back(subtree);
+		return;
+	}
+
+	Point *first = points.data();
+	QuadNode node;
+	node.box.lx = node.box.hx = first[begin].x;
+	node.box.ly = node.box.hy = first[begin].y;
+	node.minRank = first[begin].rank;
+	for (size_t i = begin + 1; i < end; i++)
+	{
+		const Point &p = first[i];
+		if (p.x < node.box.lx) node.box.lx = p.x;
+		if (p.x > node.box.hx) node.box.hx = p.x;
+		if (p.y < node.box.ly) node.box.ly = p.y;
+		if (p.y > node.box.hy) node.box.hy = p.y;
+		if (p.rank < node.minRank) node.minRank = p.rank;
+	}
+	node.begin = (uint32_t)begin;
+	node.end = (uint32_t)end;
+	node.firstChild = 0;
+	node.children = 0;
+	node.top = (uint32_t)begin;
+
+	if ((end - begin <= leafSize) || (depth >= MAX_QUAD_DEPTH))
+	{
+		/* leaf, its rank sorted Points are its own top list */
+		std::sort(first + begin, first + end, PointRankLess());
+		nodeList[index] = node;
+		return;
+	}
+
+	/* split region into quadrants at its center */
+	float mx = region.lx + (region.hx - region.lx) * 0.5f;
+	float my = region.ly + (region.hy - region.ly) * 0.5f;
+	QuadLeftOf left = { mx };
+	QuadBelow below = { my };
+	size_t xSplit = std::partition(first + begin, first + end, left) - first;
+	size_t quadrant[5];
+	quadrant[0] = begin;
+	quadrant[1] = std::partition(first + begin, first + xSplit, below) - first;
+	quadrant[2] = xSplit;
+	quadrant[3] = std::partition(first + xSplit, first + end, below) - first;
+	quadrant[4] = end;
+	BlockBox regions[4] = {
+		{ region.lx, region.ly, mx, my }, { region.lx, my, mx, region.hy },
+		{ mx, region.ly, region.hx, my }, { mx, my, region.hx, region.hy }
+	};
+
+	/* allocate non-empty children together, then build each */
+	node.firstChild = (uint32_t)nodeList.size();
+	for (int q = 0; q < 4; q++) if (quadrant[q] < quadrant[q + 1]) node.children++;
+	nodeList.resize(nodeList.size() + node.children);
+	uint32_t child = node.firstChild;
+	for (int q = 0; q < 4; q++)
+		if (quadrant[q] < quadrant[q + 1]) split(nodeList, topList, child++, quadrant[q], quadrant[q + 1], regions[q], depth + 1, deferred, deferDepth);
+	nodeList[index] = node;
+	if (deferred == NULL) gatherTop(nodeList, topList, index);
+}
+
+/* appends to topList the top list of internal node index, gathered from its children's */
+void QuadTree::gatherTop(std::vector<QuadNode> &nodeList, std::vector<uint32_t> &topList, uint32_t index) const
+{
+	/* node's top list is the best of its children's top lists */
+	QuadNode &node = nodeList[index];
+	std::vector<uint32_t> candidates;
+	for (uint32_t child = node.firstChild; child < node.firstChild + node.children; child++)
+	{
+		const QuadNode &c = nodeList[child];
+		size_t size = std::min((size_t)(c.end - c.begin), topCount);
+		for (size_t i = 0; i < size; i++)
+			candidates.push_back((c.children == 0) ? (uint32_t)(c.begin + i) : topList[c.top + i]);
+	}
+	QuadRankLess rankLess = { points.data() };
+	size_t size = std::min(candidates.size(), topCount);
+	std::partial_sort(candidates.begin(), candidates.begin() + size, candidates.end(), rankLess);
+	node.top = (uint32_t)topList.size();
+	topList.insert(topList.end(), candidates.begin(), candidates.begin() + size);
+}
+
+/* build tree over a copy of points (any order) on up to threads threads, caching topCount Points per node,
+   backed by pages of at best the requested mode, returns false (leaving the tree empty) if out of memory */
+bool QuadTree::build(const Point *points, size_t count, size_t topCount, size_t leafSize, size_t threads, PageMode pages)
+{
+	clear();
+	this->topCount = (topCount > 0) ? topCount : DEFAULT_QUAD_TOP_COUNT;
+	this->leafSize = (leafSize > 0) ? leafSize : DEFAULT_QUAD_LEAF_SIZE;
+	if (count == 0) return true;
+
+	if (!this->points.assign(points, count, pages)) return false;
+	BlockBox bounds = { points[0].x, points[0].y, points[0].x, points[0].y };
+	for (size_t i = 1; i < count; i++)
+	{
+		if (points[i].x < bounds.lx) bounds.lx = points[i].x;
+		if (points[i].x > bounds.hx) bounds.hx = points[i].x;
+		if (points[i].y < bounds.ly) bounds.ly = points[i].y;
+		if (points[i].y > bounds.hy) bounds.hy = points[i].y;
+	}
+	/* how many nodes and top list entries depends on the Points, so grow them in vectors and move them to pages after */
+	std::vector<QuadNode> nodeList;
+	std::vector<uint32_t> topList;
+	nodeList.reserve(2 * count / this->leafSize + 1);
+	nodeList.resize(1);
+	if (threads <= 1)
+		split(nodeList, topList, 0, 0, count, bounds, 0);
+	else
+	{
+		/* top levels on this thread, until there are enough subtrees below them to share out */
+		size_t depth = 0;
+		while (((size_t)1 << (2 * depth)) < threads * QUAD_SUBTREES_PER_THREAD) depth++;
+		std::vector<QuadSubtree> deferred;
+		split(nodeList, topList, 0, 0, count, bounds, 0, &deferred, depth);
+		size_t above = nodeList.size();
+
+		/* each subtree into lists of its own, root first */
+		std::vector<std::vector<QuadNode> > subNodes(deferred.size());
+		std::vector<std::vector<uint32_t> > subTops(deferred.size());
+		parallelFor(threads, deferred.size(), [&](size_t part) {
+			const QuadSubtree &subtree = deferred[part];
+			subNodes[part].resize(1);
+			split(subNodes[part], subTops[part], 0, subtree.begin, subtree.end, subtree.region, subtree.depth);
+		});
+
+		/* then appended, moving child and top list indices by where the subtree lands, its root taking the place left for it */
+		std::vector<char> built(above, 0);
+		for (size_t part = 0; part < deferred.size(); part++)
+		{
+			uint32_t nodeBase = (uint32_t)nodeList.size() - 1, topBase = (uint32_t)topList.size();
+			for (size_t i = 0; i < subNodes[part].size(); i++)
+			{
+				QuadNode node = subNodes[part][i];
+				if (node.children > 0)
+				{
+					node.firstChild += nodeBase;
+					node.top += topBase;
+				}
+				if (i == 0) nodeList[deferred[part].index] = node; else nodeList.push_back(node);
+			}
+			topList.insert(topList.end(), subTops[part].begin(), subTops[part].end());
+			built[deferred[part].index] = 1;
+			std::vector<QuadNode>().swap(subNodes[part]);
+			std::vector<uint32_t>().swap(subTops[part]);
+		}
+
+		/* and the top lists above them, children come after their parent so last node first has them ready */
+		for (size_t index = above; index-- > 0; )
+			if (!built[index] && (nodeList[index].children > 0)) gatherTop(nodeList, topList, (uint32_t)index);
+	}
+	if (!nodes.assign(&nodeList[0], nodeList.size(), pages) || !tops.assign(topList.empty() ? NULL : &topList[0], topList.size(), pages))
+	{
+		clear();
+		return false;
+	}
+	return true;
+}
+
+/* same contract as search() export */
+int32_t QuadTree::search(const Rect &rect, const int32_t count, Point *out_points) const
+{
+	if ((count <= 0) || nodes.empty()) return 0;
+
+	/* out_points doubles as a max heap on rank of best matches found, worst at top */
+	int32_t matches = 0;
+
+	/* nodes to visit, lowest minRank first, kept per thread (see KdTree::search) */
+	static thread_local std::vector<QuadVisit> queue;
+	queue.clear();
+	QuadVisit root = { nodes[0].minRank, 0 };
+	queue.push_back(root);
+
+	while (!queue.empty())
+	{
+		QuadVisit visit = queue.front();
+		std::pop_heap(queue.begin(), queue.end());
+		queue.pop_back();
+
+		/* nothing left can improve on the count matches already found */
+		if ((matches >= count) && (visit.minRank > out_points[0].rank)) break;
+
+		const QuadNode &node = nodes[visit.node];
+		const BlockBox &box = node.box;
+		if ((box.hx < rect.lx) || (box.lx > rect.hx) || (box.hy < rect.ly) || (box.ly > rect.hy)) continue;
+		bool inside = (box.lx >= rect.lx) && (box.hx <= rect.hx) && (box.ly >= rect.ly) && (box.hy <= rect.hy);
+		size_t size = node.end - node.begin;
+
+		if (inside && ((size_t)count <= topCount || size <= topCount))
+		{
+			/* covered entirely and cached list holds every Point it could contribute */
+			size_t cached = std::min(size, topCount);
+			for (size_t i = 0; i < cached; i++)
+			{
+				const Point &p = points[(node.children == 0) ? node.begin + i : tops[node.top + i]];
+				if ((matches >= count) && (p.rank > out_points[0].rank)) break;
+				keepBest(p, out_points, matches, count);
+			}
+			continue;
+		}
+
+		if (node.children == 0)
+		{
+			/* border leaf, Points are rank sorted so stop once they can no longer improve result */
+			for (const Point *p = &points[node.begin], *pEnd = &points[0] + node.end; p < pEnd; ++p)
+			{
+				if ((matches >= count) && (p->rank > out_points[0].rank)) break;
+				if (inside || inRect(*p, rect)) keepBest(*p, out_points, matches, count);
+			}
+			continue;
+		}
+
+		/* border node, queue children that could still improve result */
+		for (uint32_t child = node.firstChild; child < node.firstChild + node.children; child++)
+		{
+			if ((matches >= count) && (nodes[child].minRank > out_points[0].rank)) continue;
+			QuadVisit next = { nodes[child].minRank, child };
+			queue.push_back(next);
+			std::push_heap(queue.begin(), queue.end());
+		}
+	}
+
+	/* turn heap into lowest rank first order */
+	std::sort_heap(out_points, out_points + matches, PointRankLess());
+	return matches;
+}
+
+/* release memory used by the index */
+void QuadTree::clear(void)
+{
+	nodes.clear();
+	points.clear();
+	tops.clear();
+}
@@ -0,0 +1,88 @@
+#pragma once
+#ifndef __QUAD_TREE__
+#define __QUAD_TREE__
+
+#include <stddef.h>
+#include <vector>
+#include "point_search.h"
+#include "block_index.h"
+#include "aligned_array.h"
+
+/* default most Points held by a leaf of the quadtree */
+#define DEFAULT_QUAD_LEAF_SIZE 64
+/* default number of lowest ranked Points cached per node, matches point_search default -r */
+#define DEFAULT_QUAD_TOP_COUNT 20
+/* deepest level split, guards against many Points with identical coordinates */
+#define MAX_QUAD_DEPTH 32
+/* subtrees per thread a parallel build hands out, more balance uneven subtrees better */
+#define QUAD_SUBTREES_PER_THREAD 4
+
+/* node of the quadtree, children of a node are stored next to each other */
+struct QuadNode {
+	BlockBox box;          /* tight bounding box of all Points below node             */
+	int32_t minRank;       /* lowest rank of any Point below node                     */
+	uint32_t begin;        /* first Point below node                                  */
+	uint32_t end;          /* one past last Point below node                          */
+	uint32_t firstChild;   /* index of first child node                               */
+	uint32_t children;     /* number of (non-empty) children, 0 if node is a leaf     */
+	uint32_t top;          /* first entry in top list of node's lowest ranked Points  */
+};
+
+/* subtree whose building is left for later, so subtrees can be built on several threads */
+struct QuadSubtree {
+	uint32_t index;       /* node of its root     */
+	size_t begin, end;    /* Points of subtree    */
+	BlockBox region;      /* region it splits     */
+	size_t depth;         /* depth of its root    */
+};
+
+/* Point region quadtree where every node caches the topCount lowest ranked Points below it.  A search
+   takes the cached list of a node entirely covered by the rect instead of descending, so only nodes
+   on the border of the rect are opened and large rects cost about count log(nodes) rather than a
+   scan.  When more than topCount Points are requested covered nodes are opened like any other. */
+class QuadTree
+{
+public:
+	QuadTree(void);
+
+	/* build tree over a copy of points (any order) on up to threads threads, caching topCount Points per node,
+	   backed by pages of at best the requested mode, returns false (leaving the tree empty) if out of memory */
+	bool build(const Point *points, size_t count, size_t topCount = DEFAULT_QUAD_TOP_COUNT, size_t leafSize = DEFAULT_QUAD_LEAF_SIZE,
+		size_t threads = 1, PageMode pages = PAGES_SMALL);
+
+	/* same contract as search() export */
+	int32_t search(const Rect &rect, const int32_t count, Point *out_points) const;
+
+	/* adds nodes, Points and top lists to report, prefaulting and locking them as asked */
+	void report(PageReport &report, bool prefault, bool lock) const
+	{
+		nodes.report(report, prefault, lock);
+		points.report(report, prefault, lock);
+		tops.report(report, prefault, lock);
+	}
+
+	/* release memory used by the index */
+	void clear(void);
+
+private:
+	/* not copyable */
+	QuadTree(const QuadTree &);
+	QuadTree &operator=(const QuadTree &);
+
+	/* recursively build node (already allocated in nodeList) over points [begin,end) within region, appending
+	   children to nodeList and top lists to topList, which are copied to nodes and tops once complete; when
+	   deferred is given subtrees at deferDepth are appended to it instead and no top lists are gathered */
+	void split(std::vector<QuadNode> &nodeList, std::vector<uint32_t> &topList, uint32_t index, size_t begin, size_t end, BlockBox region, size_t depth,
+		std::vector<QuadSubtree> *deferred = NULL, size_t deferDepth = 0);
+
+	/* appends to topList the top list of internal node index, gathered from its children's */
+	void gatherTop(std::vector<QuadNode> &nodeList, std::vector<uint32_t> &topList, uint32_t index) const;
+
+	size_t topCount;                  /* Points cached per node                          */
+	size_t leafSize;                  /* most Points per leaf                            */
+	AlignedArray<QuadNode> nodes;     /* flat array of nodes, root first                 */
+	AlignedArray<Point> points;       /* Points in leaf order, rank sorted per leaf      */
+	AlignedArray<uint32_t> tops;      /* top lists of internal nodes, index into points  */
+};
+
+#endif /* __QUAD_TREE__ */
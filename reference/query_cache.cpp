@@ -0,0 +1,157 @@
+#include "query_cache.h"
+#include "rank_merge.h"
+#include <algorithm> /* for std::min */
+#include <string.h>  /* for memcpy    */
+
+
+QueryCache::QueryCache(void) : budget(0), bytes(0), hits(0), semanticHits(0), misses(0), busy(0), evictions(0)
+{
+}
+
+/* empties the cache and sets its budget, 0 disables it */
+void QueryCache::configure(size_t budget)
+{
+	clear();
+	this->budget = budget;
+	hits = semanticHits = misses = busy = evictions = 0;
+}
+
+/* exact bits of a query, so lookups never depend on float comparisons */
+QueryCache::Key QueryCache::makeKey(const Rect &rect, const int32_t count)
+{
+	Key key;
+	memcpy(&key.lx, &rect.lx, sizeof(key.lx));
+	memcpy(&key.ly, &rect.ly, sizeof(key.ly));
+	memcpy(&key.hx, &rect.hx, sizeof(key.hx));
+	memcpy(&key.hy, &rect.hy, sizeof(key.hy));
+	key.count = count;
+	return key;
+}
+
+size_t QueryCache::KeyHash::operator()(const Key &key) const
+{
+	/* multiply and rotate each word in, then fold the high bits down */
+	uint64_t h = (uint32_t)key.count;
+	const uint32_t words[4] = { key.lx, key.ly, key.hx, key.hy };
+	for (int i = 0; i < 4; i++)
+	{
+		h = (h ^ words[i]) * 0x9E3779B97F4A7C15ull;
+		h = (h << 31) | (h >> 33);
+	}
+	return (size_t)(h ^ (h >> 29));
+}
+
+/* copies the cached answer into out_points and returns its length, or -1 if not cached */
+int32_t QueryCache::lookup(const Rect &rect, const int32_t count, Point *out_points)
+{
+	/* inverted or NaN rects are answered by the engines without any work */
+	if (!enabled() || (count <= 0) || !(rect.lx <= rect.hx) || !(rect.ly <= rect.hy)) return -1;
+
+	std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+	if (!lock.owns_lock())
+	{
+		busy++;
+		misses++;
+		return -1;
+	}
+
+	/* repeat of a cached query */
+	auto found = index.find(makeKey(rect, count));
+	if (found != index.end())
+	{
+		EntryList::iterator e = found->second;
+		entries.splice(entries.begin(), entries, e);
+		int32_t matches = (int32_t)e->points.size();
+		if (matches > 0) memcpy(out_points, &e->points[0], matches * sizeof(Point));
+		hits++;
+		return matches;
+	}
+
+	/* filter a result cached for a rect containing this one, most recently used first */
+	size_t scanned = 0;
+	for (EntryList::iterator e = entries.begin(); (e != entries.end()) && (scanned < QUERY_CACHE_SCAN_ENTRIES); ++e, scanned++)
+	{
+		const Rect &outer = e->rect;
+		if ((outer.lx > rect.lx) || (outer.ly > rect.ly) || (outer.hx < rect.hx) || (outer.hy < rect.hy)) continue;
+
+		int32_t matches = 0;
+		for (size_t i = 0; (i < e->points.size()) && (matches < count); i++)
+			if (inRect(e->points[i], rect)) out_points[matches++] = e->points[i];
+		bool exhaustive = ((int32_t)e->points.size() < e->count);
+		if ((matches < count) && !exhaustive) continue;
+
+		entries.splice(entries.begin(), entries, e);
+		semanticHits++;
+		return matches;
+	}
+
+	misses++;
+	return -1;
+}
+
+/* caches matches Points found by a search for (rect, count), evicting older results as needed */
+void QueryCache::insert(const Rect &rect, const int32_t count, const Point *points, const int32_t matches)
+{
+	if (!enabled() || (count <= 0) || (matches < 0) || !(rect.lx <= rect.hx) || !(rect.ly <= rect.hy)) return;
+	size_t size = matches * sizeof(Point) + QUERY_CACHE_ENTRY_OVERHEAD;
+	if (size > budget) return;
+
+	/* allocate the entry before taking the mutex so other threads are kept out only briefly */
+	EntryList fresh(1);
+	Entry &entry = fresh.front();
+	entry.key = makeKey(rect, count);
+	entry.rect = rect;
+	entry.count = count;
+	entry.points.assign(points, points + matches);
+	entry.bytes = size;
+
+	std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+	if (!lock.owns_lock())
+	{
+		busy++;
+		return;
+	}
+	/* another thread may have searched and cached the same query meanwhile */
+	if (index.find(entry.key) != index.end()) return;
+
+	evict(budget - size);
+	entries.splice(entries.begin(), fresh);
+	index[entries.front().key] = entries.begin();
+	bytes += size;
+}
+
+/* drops least recently used entries until bytes fits within limit, mutex must be held */
+void QueryCache::evict(size_t limit)
+{
+	while ((bytes > limit) && !entries.empty())
+	{
+		const Entry &oldest = entries.back();
+		bytes -= oldest.bytes;
+		index.erase(oldest.key);
+		entries.pop_back();
+		evictions++;
+	}
+}
+
+/* current counters */
+void QueryCache::stats(QueryCacheStats &out)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	out.hits = hits;
+	out.semanticHits = semanticHits;
+	out.misses = misses;
+	out.busy = busy;
+	out.evictions = evictions;
+	out.entries = index.size();
+	out.bytes = bytes;
+	out.budget = budget;
+}
+
+/* release memory used by the cache */
+void QueryCache::clear(void)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	EntryList().swap(entries);
+	index.clear();
+	bytes = 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#ifndef __QUERY_CACHE__
+#define __QUERY_CACHE__
+
+#include <stddef.h>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include "point_search.h"
+
+/* bytes charged per cached result beyond its Points, covering the entry, list and hash map nodes */
+#define QUERY_CACHE_ENTRY_OVERHEAD 128
+/* most recently used results a lookup checks for a rect containing its own, bounding the time the mutex is held on a miss */
+#define QUERY_CACHE_SCAN_ENTRIES 64
+
+/* Bounded least recently used cache of search results keyed on (Rect, count), sized in bytes.
+   Besides exact repeats a cached result answers any rect inside its own by filtering: every Point of
+   the inner rect that is missing from the filtered list ranks after all the cached Points, so the
+   filtered list is the inner rect's answer whenever it is long enough, or whenever the cached result
+   was exhaustive (held fewer Points than asked for).  Only the QUERY_CACHE_SCAN_ENTRIES most recently
+   used results are checked for one containing the rect: panning and zooming mostly reuse recent results,
+   and checking them all would make every miss take time in the size of the cache.  The cache is shared
+   by every thread searching a context but never waits: a thread finding it in use by another searches
+   without it. */
+class QueryCache
+{
+public:
+	QueryCache(void);
+
+	/* empties the cache and sets its budget, 0 disables it */
+	void configure(size_t budget);
+
+	/* is the cache in use? */
+	bool enabled(void) const { return budget > 0; }
+
+	/* copies the cached answer into out_points and returns its length, or -1 if not cached */
+	int32_t lookup(const Rect &rect, const int32_t count, Point *out_points);
+
+	/* caches matches Points found by a search for (rect, count), evicting older results as needed */
+	void insert(const Rect &rect, const int32_t count, const Point *points, const int32_t matches);
+
+	/* current counters, QueryCacheStats is declared in point_search.h for the cache_stats() export */
+	void stats(QueryCacheStats &out);
+
+	/* release memory used by the cache */
+	void clear(void);
+
+private:
+	/* exact bits of a query, so lookups never depend on float comparisons */
+	struct Key {
+		uint32_t lx, ly, hx, hy;
+		int32_t count;
+		bool operator==(const Key &other) const {
+			return (lx == other.lx) && (ly == other.ly) && (hx == other.hx) && (hy == other.hy) && (count == other.count);
+		}
+	};
+	struct KeyHash {
+		size_t operator()(const Key &key) const;
+	};
+	struct Entry {
+		Key key;
+		Rect rect;
+		int32_t count;
+		std::vector<Point> points;
+		size_t bytes;
+	};
+	typedef std::list<Entry> EntryList;
+
+	static Key makeKey(const Rect &rect, const int32_t count);
+
+	/* drops least recently used entries until bytes fits within limit, mutex must be held */
+	void evict(size_t limit);
+
+	/* most recently used first */
+	EntryList entries;
+	std::unordered_map<Key, EntryList::iterator, KeyHash> index;
+	std::mutex mutex;
+	size_t budget;
+	size_t bytes;
+
+	std::atomic<uint64_t> hits, semanticHits, misses, busy, evictions;
+};
+
+#endif /* __QUERY_CACHE__ */
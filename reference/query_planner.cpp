@@ -0,0 +1,102 @@
+#include "query_planner.h"
+#include "rank_merge.h"
+#include "parallel_for.h"
+#include <algorithm> /* for std::min, std::sort, heap functions */
+#include <string.h>  /* for memcpy */
+
+/* fewest Points searched for the lowest ranks by each thread */
+#define PLANNER_PART_MIN 65536
+
+
+QueryPlanner::QueryPlanner(void)
+{
+}
+
+/* count points (any order) into a cells per side prefix grid and keep the lowest ranked */
+void QueryPlanner::build(const Point *points, size_t count, size_t cells, size_t threads)
+{
+	clear();
+	grid.build(points, count, cells, threads);
+	if (count == 0) return;
+
+	/* each part keeps its lowest ranks in a max heap, most Points are rejected by one compare with its top */
+	size_t keep = std::min(count, (size_t)PLANNER_TOP_POINTS);
+	size_t parts = std::max((size_t)1, std::min(threads, count / PLANNER_PART_MIN));
+	std::vector<std::vector<Point> > partTops(parts);
+	parallelFor(threads, parts, [&](size_t part) {
+		std::vector<Point> &heap = partTops[part];
+		heap.reserve(keep);
+		for (const Point *p = points + partStart(count, parts, part), *pEnd = points + partStart(count, parts, part + 1); p < pEnd; ++p)
+		{
+			if (heap.size() < keep)
+			{
+				heap.push_back(*p);
+				std::push_heap(heap.begin(), heap.end(), PointRankLess());
+			}
+			else if (p->rank < heap.front().rank)
+			{
+				std::pop_heap(heap.begin(), heap.end(), PointRankLess());
+				heap.back() = *p;
+				std::push_heap(heap.begin(), heap.end(), PointRankLess());
+			}
+		}
+	});
+	std::vector<Point> lowest;
+	for (size_t part = 0; part < parts; part++) lowest.insert(lowest.end(), partTops[part].begin(), partTops[part].end());
+	std::sort(lowest.begin(), lowest.end(), PointRankLess());
+	tops.assign(&lowest[0], keep);
+}
+
+/* expected rank order depth of the count'th match of rect */
+double QueryPlanner::depth(const Rect &rect, const int32_t count) const
+{
+	double n = (double)grid.total(), matches = grid.estimate(rect);
+	if (matches <= (double)count) return n;
+	return std::min(n, (double)count * n / matches);
+}
+
+/* best plan for a search of rect, callers without a spatial index scan instead of PLAN_SPATIAL */
+SearchPlan QueryPlanner::plan(const Rect &rect, const int32_t count, size_t depthLimit) const
+{
+	if ((count <= 0) || !(rect.lx <= rect.hx) || !(rect.ly <= rect.hy)) return PLAN_EMPTY;
+	if (grid.upperBound(rect) == 0) return PLAN_EMPTY;
+
+	/* a rect covering the bounds of the data holds every Point */
+	const Rect &box = grid.bounds();
+	if ((rect.lx <= box.lx) && (rect.ly <= box.ly) && (rect.hx >= box.hx) && (rect.hy >= box.hy) &&
+		(((size_t)count <= tops.size()) || (tops.size() == grid.total())))
+		return PLAN_TOP;
+
+	return (depth(rect, count) > (double)depthLimit) ? PLAN_SPATIAL : PLAN_SCAN;
+}
+
+/* copies the count (at most) lowest ranked Points into out_points for PLAN_TOP, returns number copied */
+int32_t QueryPlanner::top(const int32_t count, Point *out_points) const
+{
+	int32_t matches = (int32_t)std::min((size_t)count, tops.size());
+	if (matches > 0) memcpy(out_points, &tops[0], matches * sizeof(Point));
+	return matches;
+}
+
+/* release memory used by the planner */
+void QueryPlanner::clear(void)
+{
+	grid.clear();
+	tops.clear();
+}
+
+/* adds the planner's sections to writer */
+void QueryPlanner::save(IndexWriter &writer) const
+{
+	grid.save(writer);
+	writer.add(SECTION_PLANNER_TOPS, tops);
+}
+
+/* views the planner saved in file, which must stay open until cleared, returns false if file holds none */
+bool QueryPlanner::load(const IndexFile &file)
+{
+	clear();
+	if (grid.load(file) && file.view(SECTION_PLANNER_TOPS, tops) && (tops.size() <= grid.total())) return true;
+	clear();
+	return false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef __QUERY_PLANNER__
+#define __QUERY_PLANNER__
+
+#include <stddef.h>
+#include <vector>
+#include "point_search.h"
+#include "prefix_grid.h"
+#include "aligned_array.h"
+#include "index_file.h"
+
+/* lowest ranked Points kept to answer rects covering all the data directly */
+#define PLANNER_TOP_POINTS 1024
+/* default expected rank order depth of the count'th match beyond which a spatial index is used */
+#define DEFAULT_PLANNER_DEPTH 524288
+
+/* how a search is best answered */
+enum SearchPlan {
+	PLAN_EMPTY,     /* inverted rect, no count, or rect holds no Point at all        */
+	PLAN_TOP,       /* rect covers all the data, the lowest ranks are the answer      */
+	PLAN_SCAN,      /* matches are common, walk the rank order (block index)          */
+	PLAN_SPATIAL    /* matches are rare, descend a spatial index (k-d tree)           */
+};
+
+/* Picks a search plan per query from a prefix count grid built at create.  From the estimated number
+   of matches m of n Points, and ranks being independent of position, the count'th match is expected
+   about count * n / m Points down the rank order; a rank ordered scan is chosen while that depth is
+   small, a spatial index once it is not. */
+class QueryPlanner
+{
+public:
+	QueryPlanner(void);
+
+	/* count points (any order) into a cells per side prefix grid and keep the lowest ranked */
+	void build(const Point *points, size_t count, size_t cells = DEFAULT_PREFIX_CELLS, size_t threads = 1);
+
+	/* best plan for a search of rect, callers without a spatial index scan instead of PLAN_SPATIAL */
+	SearchPlan plan(const Rect &rect, const int32_t count, size_t depthLimit = DEFAULT_PLANNER_DEPTH) const;
+
+	/* copies the count (at most) lowest ranked Points into out_points for PLAN_TOP, returns number copied */
+	int32_t top(const int32_t count, Point *out_points) const;
+
+	/* expected rank order depth of the count'th match of rect */
+	double depth(const Rect &rect, const int32_t count) const;
+
+	/* prefix count grid the plans are made from */
+	const PrefixGrid &prefix(void) const { return grid; }
+
+	/* bytes of memory used by the planner */
+	size_t memoryUsed(void) const { return grid.memoryUsed() + tops.size() * sizeof(Point); }
+
+	/* adds the planner's sections to writer */
+	void save(IndexWriter &writer) const;
+
+	/* views the planner saved in file, which must stay open until cleared, returns false if file holds none */
+	bool load(const IndexFile &file);
+
+	/* release memory used by the planner */
+	void clear(void);
+
+private:
+	PrefixGrid grid;
+	AlignedArray<Point> tops;   /* lowest PLANNER_TOP_POINTS ranks, lowest first */
+};
+
+#endif /* __QUERY_PLANNER__ */
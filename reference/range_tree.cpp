@@ -0,0 +1,367 @@
+#include "range_tree.h"
+#include "rank_merge.h"
+#include "parallel_sort.h"
+#include <algorithm> /* for std::sort, std::lower_bound, std::upper_bound, heap functions */
+
+
+/* orders rank order positions by a coordinate of their Point, ties by rank */
+struct RangeXLess {
+	const Point *points;
+	bool operator()(uint32_t a, uint32_t b) const { return (points[a].x < points[b].x) || ((points[a].x == points[b].x) && (a < b)); }
+};
+struct RangeYLess {
+	const Point *points;
+	bool operator()(uint32_t a, uint32_t b) const { return (points[a].y < points[b].y) || ((points[a].y == points[b].y) && (a < b)); }
+};
+
+/* Cartesian tree root (lowest id of a y range) or run of sorted leaf matches, waiting to be reported */
+struct RangeCandidate {
+	uint32_t id;     /* rank order position of Point to report next      */
+	int32_t level;   /* level of y range, or -1 for leaf match list      */
+	uint32_t l, r;   /* remaining range [l,r) within level or leaf list   */
+	uint32_t pos;    /* position of id within level                       */
+	bool operator<(const RangeCandidate &other) const { return id > other.id; }
+};
+
+/* node of the x tree still to be split into canonical nodes */
+struct RangeNode {
+	uint32_t begin, end;
+	int32_t depth;
+};
+
+
+/* largest j with 2^j <= n, n > 0 */
+static inline size_t floorLog2(size_t n)
+{
+	size_t j = 0;
+	while (n >>= 1) j++;
+	return j;
+}
+
+/* position within [l,r) of lowest id, range must not be empty */
+uint32_t RangeTree::Level::minPosition(uint32_t l, uint32_t r) const
+{
+	const uint32_t *id = ids;
+	size_t bl = l / RANGE_RMQ_BLOCK, br = (r - 1) / RANGE_RMQ_BLOCK;
+	uint32_t best = l;
+	if (br - bl <= 1)
+	{
+		/* short range, just scan it */
+		for (uint32_t i = l + 1; i < r; i++) if (id[i] < id[best]) best = i;
+		return best;
+	}
+
+	/* partial blocks at both ends */
+	for (uint32_t i = l + 1, iEnd = (uint32_t)((bl + 1) * RANGE_RMQ_BLOCK); i < iEnd; i++) if (id[i] < id[best]) best = i;
+	for (uint32_t i = (uint32_t)(br * RANGE_RMQ_BLOCK); i < r; i++) if (id[i] < id[best]) best = i;
+
+	/* whole blocks in between from two overlapping power of 2 spans */
+	size_t span = br - bl - 1;
+	size_t j = floorLog2(span);
+	uint32_t a = table[j * blocks + bl + 1];
+	uint32_t b = table[j * blocks + br - ((size_t)1 << j)];
+	if (id[a] < id[best]) best = a;
+	if (id[b] < id[best]) best = b;
+	return best;
+}
+
+
+RangeTree::RangeTree(void)
+{
+	count = 0;
+	leafSize = DEFAULT_RANGE_LEAF_SIZE;
+}
+
+/* moves the ids at [from,to) of current that lie left of x order position mid to next from left on, and the others from
+   right on, keeping their order */
+static inline void partitionIds(const uint32_t *current, uint32_t *next, const uint32_t *xPosition, uint32_t mid, size_t from, size_t to,
+	size_t left, size_t right)
+{
+	for (size_t i = from; i < to; i++)
+	{
+		uint32_t id = current[i];
+		if (xPosition[id] < mid) next[left++] = id; else next[right++] = id;
+	}
+}
+
+/* build tree over points (any order) on up to threads threads, backed by pages of at best the requested
+   mode, returns false (leaving the tree empty) if out of memory */
+bool RangeTree::build(const Point *points, size_t count, size_t leafSize, size_t threads, PageMode pages)
+{
+	clear();
+	this->leafSize = (leafSize > 0) ? leafSize : DEFAULT_RANGE_LEAF_SIZE;
+	if (count == 0) return true;
+
+	/* nodes at a depth differ in size by at most one, so the depths with internal nodes are known up front
+	   and every one of them holds all count Points, letting the levels share arrays allocated once */
+	size_t levelTotal = 0;
+	for (size_t size = count; size > this->leafSize; size -= size / 2) levelTotal++;
+	size_t blocks = (count + RANGE_RMQ_BLOCK - 1) / RANGE_RMQ_BLOCK;
+	size_t rows = floorLog2(blocks) + 1;
+	if (!byRank.resize(count, pages) || !xIds.resize(count, pages) || !xs.resize(count, pages) ||
+		!levelYs.resize(levelTotal * count, pages) || !levelIds.resize(levelTotal * count, pages) ||
+		!levelTables.resize(levelTotal * rows * blocks, pages))
+	{
+		clear();
+		return false;
+	}
+	this->count = count;
+
+	/* Points in rank order, position in this order identifies a Point */
+	sortByRank(points, count, byRank.data(), threads);
+
+	/* x order for splitting and leaves */
+	for (size_t i = 0; i < count; i++) xIds[i] = (uint32_t)i;
+	RangeXLess xLess = { byRank.data() };
+	parallelSort(xIds.data(), count, xLess, threads);
+	std::vector<uint32_t> xPosition(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		xs[i] = byRank[xIds[i]].x;
+		xPosition[xIds[i]] = (uint32_t)i;
+	}
+
+	/* root holds all Points in y order */
+	std::vector<uint32_t> current(xIds.data(), xIds.data() + count), next(count);
+	RangeYLess yLess = { byRank.data() };
+	parallelSort(&current[0], count, yLess, threads);
+
+	/* passes over a level are split into slices of whole blocks */
+	size_t slices = (threads > 1) ? std::min(blocks, threads * RANGE_SLICES_PER_THREAD) : 1;
+
+	/* internal nodes at current depth */
+	std::vector<RangeNode> nodes, children;
+	if (count > this->leafSize)
+	{
+		RangeNode root = { 0, (uint32_t)count, 0 };
+		nodes.push_back(root);
+	}
+
+	while (!nodes.empty())
+	{
+		/* y sorted Points of every node at this depth */
+		size_t depth = levels.size();
+		float *ys = levelYs.data() + depth * count;
+		uint32_t *ids = levelIds.data() + depth * count;
+		uint32_t *table = levelTables.data() + depth * rows * blocks;
+
+		/* copied block by block together with the first row of the sparse table, the position of the lowest id of each block */
+		parallelFor(threads, slices, [&](size_t slice) {
+			for (size_t k = partStart(blocks, slices, slice), kEnd = partStart(blocks, slices, slice + 1); k < kEnd; k++)
+			{
+				uint32_t best = (uint32_t)(k * RANGE_RMQ_BLOCK);
+				ids[best] = current[best];
+				ys[best] = byRank[current[best]].y;
+				for (uint32_t i = best + 1, iEnd = (uint32_t)std::min(count, (k + 1) * RANGE_RMQ_BLOCK); i < iEnd; i++)
+				{
+					ids[i] = current[i];
+					ys[i] = byRank[current[i]].y;
+					if (current[i] < current[best]) best = i;
+				}
+				table[k] = best;
+			}
+		});
+
+		/* each further row j holds position of lowest id over 2^j blocks starting at each block */
+		for (size_t j = 1; j < rows; j++)
+		{
+			const uint32_t *prev = table + (j - 1) * blocks;
+			uint32_t *row = table + j * blocks;
+			size_t half = (size_t)1 << (j - 1);
+			parallelFor(threads, slices, [&](size_t slice) {
+				for (size_t k = partStart(blocks, slices, slice), kEnd = partStart(blocks, slices, slice + 1); k < kEnd; k++)
+				{
+					uint32_t a = prev[k];
+					uint32_t b = (k + half < blocks) ? prev[k + half] : a;
+					row[k] = (current[b] < current[a]) ? b : a;
+				}
+			});
+		}
+		Level level = { ys, ids, table, blocks };
+		levels.push_back(level);
+
+		/* stable partition of each node by x half gives y sorted children, a node per thread once there are
+		   enough of them, before that each node in slices that first count their left ids to know where to write */
+		if ((threads > 1) && (nodes.size() >= threads))
+			parallelFor(threads, nodes.size(), [&](size_t n) {
+				const RangeNode &node = nodes[n];
+				uint32_t mid = node.begin + (node.end - node.begin) / 2;
+				partitionIds(&current[0], &next[0], &xPosition[0], mid, node.begin, node.end, node.begin, mid);
+			});
+		else
+			for (std::vector<RangeNode>::const_iterator node = nodes.begin(); node != nodes.end(); ++node)
+			{
+				uint32_t mid = node->begin + (node->end - node->begin) / 2;
+				std::vector<size_t> lefts(slices + 1, 0);
+				parallelFor(threads, slices, [&](size_t slice) {
+					for (size_t i = node->begin + partStart(node->end - node->begin, slices, slice),
+						iEnd = node->begin + partStart(node->end - node->begin, slices, slice + 1); i < iEnd; i++)
+						if (xPosition[current[i]] < mid) lefts[slice + 1]++;
+				});
+				for (size_t slice = 0; slice < slices; slice++) lefts[slice + 1] += lefts[slice];
+				parallelFor(threads, slices, [&](size_t slice) {
+					size_t from = node->begin + partStart(node->end - node->begin, slices, slice);
+					size_t to = node->begin + partStart(node->end - node->begin, slices, slice + 1);
+					partitionIds(&current[0], &next[0], &xPosition[0], mid, from, to, node->begin + lefts[slice],
+						mid + (from - node->begin) - lefts[slice]);
+				});
+			}
+		children.clear();
+		for (std::vector<RangeNode>::const_iterator node = nodes.begin(); node != nodes.end(); ++node)
+		{
+			uint32_t mid = node->begin + (node->end - node->begin) / 2;
+			RangeNode child = { node->begin, mid, node->depth + 1 };
+			if (mid - node->begin > this->leafSize) children.push_back(child);
+			child.begin = mid;
+			child.end = node->end;
+			if (node->end - mid > this->leafSize) children.push_back(child);
+		}
+		current.swap(next);
+		nodes.swap(children);
+	}
+	return true;
+}
+
+/* same contract as search() export */
+int32_t RangeTree::search(const Rect &rect, const int32_t count, Point *out_points) const
+{
+	if ((count <= 0) || (this->count == 0)) return 0;
+	if ((rect.lx > rect.hx) || (rect.ly > rect.hy)) return 0;
+
+	/* x range of positions in x order */
+	const float *xBegin = xs.data(), *xEnd = xBegin + xs.size();
+	uint32_t xb = (uint32_t)(std::lower_bound(xBegin, xEnd, rect.lx) - xBegin);
+	uint32_t xe = (uint32_t)(std::upper_bound(xBegin, xEnd, rect.hx) - xBegin);
+	if (xb >= xe) return 0;
+
+	/* kept per thread (see KdTree::search) */
+	static thread_local std::vector<RangeCandidate> heap;
+	static thread_local std::vector<uint32_t> leafMatches;
+	heap.clear();
+	leafMatches.clear();
+
+	/* split x range into canonical nodes, scanning leaves that are reached */
+	RangeNode stack[64];
+	size_t depth = 0;
+	RangeNode root = { 0, (uint32_t)this->count, 0 };
+	stack[depth++] = root;
+	while (depth > 0)
+	{
+		RangeNode node = stack[--depth];
+		if ((node.end <= xb) || (node.begin >= xe)) continue;
+
+		if (node.end - node.begin <= leafSize)
+		{
+			/* leaf, test each Point in x range */
+			uint32_t b = std::max(node.begin, xb), e = std::min(node.end, xe);
+			for (uint32_t i = b; i < e; i++)
+			{
+				const Point &p = byRank[xIds[i]];
+				if ((p.y >= rect.ly) && (p.y <= rect.hy)) leafMatches.push_back(xIds[i]);
+			}
+		}
+		else if ((xb <= node.begin) && (node.end <= xe))
+		{
+			/* canonical node, its y range is the root of a Cartesian tree */
+			const Level &level = levels[node.depth];
+			const float *ys = level.ys;
+			uint32_t l = (uint32_t)(std::lower_bound(ys + node.begin, ys + node.end, rect.ly) - ys);
+			uint32_t r = (uint32_t)(std::upper_bound(ys + l, ys + node.end, rect.hy) - ys);
+			if (l < r)
+			{
+				RangeCandidate c;
+				c.pos = level.minPosition(l, r);
+				c.id = level.ids[c.pos];
+				c.level = node.depth;
+				c.l = l;
+				c.r = r;
+				heap.push_back(c);
+			}
+		}
+		else
+		{
+			/* partially covered, split into halves */
+			uint32_t mid = node.begin + (node.end - node.begin) / 2;
+			RangeNode child = { node.begin, mid, node.depth + 1 };
+			stack[depth++] = child;
+			child.begin = mid;
+			child.end = node.end;
+			stack[depth++] = child;
+		}
+	}
+	if (!leafMatches.empty())
+	{
+		std::sort(leafMatches.begin(), leafMatches.end());
+		RangeCandidate c = { leafMatches[0], -1, 0, (uint32_t)leafMatches.size(), 0 };
+		heap.push_back(c);
+	}
+	std::make_heap(heap.begin(), heap.end());
+
+	/* report lowest id, replacing it by the roots of its two Cartesian subtrees */
+	int32_t matches = 0;
+	while (!heap.empty() && (matches < count))
+	{
+		RangeCandidate c = heap.front();
+		std::pop_heap(heap.begin(), heap.end());
+		heap.pop_back();
+		out_points[matches++] = byRank[c.id];
+
+		if (c.level < 0)
+		{
+			if (c.l + 1 < c.r)
+			{
+				RangeCandidate n = { leafMatches[c.l + 1], -1, c.l + 1, c.r, 0 };
+				heap.push_back(n);
+				std::push_heap(heap.begin(), heap.end());
+			}
+			continue;
+		}
+
+		const Level &level = levels[c.level];
+		RangeCandidate side[2] = { c, c };
+		side[0].r = c.pos;
+		side[1].l = c.pos + 1;
+		for (int i = 0; i < 2; i++)
+		{
+			if (side[i].l >= side[i].r) continue;
+			side[i].pos = level.minPosition(side[i].l, side[i].r);
+			side[i].id = level.ids[side[i].pos];
+			heap.push_back(side[i]);
+			std::push_heap(heap.begin(), heap.end());
+		}
+	}
+	return matches;
+}
+
+/* bytes of memory used by the index */
+size_t RangeTree::memoryUsed(void) const
+{
+	size_t bytes = sizeof(*this) + levels.capacity() * sizeof(Level);
+	bytes += byRank.size() * sizeof(Point) + xs.size() * sizeof(float) + xIds.size() * sizeof(uint32_t);
+	bytes += levelYs.size() * sizeof(float) + levelIds.size() * sizeof(uint32_t) + levelTables.size() * sizeof(uint32_t);
+	return bytes;
+}
+
+/* adds every array of the tree to report, prefaulting and locking them as asked */
+void RangeTree::report(PageReport &report, bool prefault, bool lock) const
+{
+	byRank.report(report, prefault, lock);
+	xs.report(report, prefault, lock);
+	xIds.report(report, prefault, lock);
+	levelYs.report(report, prefault, lock);
+	levelIds.report(report, prefault, lock);
+	levelTables.report(report, prefault, lock);
+}
+
+/* release memory used by the index */
+void RangeTree::clear(void)
+{
+	count = 0;
+	byRank.clear();
+	xs.clear();
+	xIds.clear();
+	levelYs.clear();
+	levelIds.clear();
+	levelTables.clear();
+	std::vector<Level>().swap(levels);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#ifndef __RANGE_TREE__
+#define __RANGE_TREE__
+
+#include <stddef.h>
+#include <vector>
+#include "point_search.h"
+#include "aligned_array.h"
+
+/* default most Points in a leaf of the x tree, leaves are scanned instead of having a y structure */
+#define DEFAULT_RANGE_LEAF_SIZE 2048
+/* positions covered by each entry of the range minimum structure */
+#define RANGE_RMQ_BLOCK 64
+/* slices per thread the passes over a level are split into */
+#define RANGE_SLICES_PER_THREAD 4
+
+/* Range tree answering top count by rank inside a rect in O(log^2 n + count log count) time.
+   The primary tree splits the x sorted Points in halves down to leaves of leafSize Points.  Every
+   internal node keeps its Points sorted by y (a merge sort tree, stored level by level) together with
+   a range minimum structure over their ranks, which is the implicit Cartesian tree of that sequence:
+   the lowest rank of any y range is its root and the two sides of the root are its subtrees.  A search
+   splits the x range into O(log n) nodes, binary searches the y range within each and then pops
+   Cartesian tree roots from a heap in rank order until count Points are found.  Points are referred to
+   by their position in rank order, so comparing positions compares ranks.  Memory is O(n log(n/leafSize)). */
+class RangeTree
+{
+public:
+	RangeTree(void);
+
+	/* build tree over points (any order) on up to threads threads, backed by pages of at best the requested
+	   mode, returns false (leaving the tree empty) if out of memory */
+	bool build(const Point *points, size_t count, size_t leafSize = DEFAULT_RANGE_LEAF_SIZE, size_t threads = 1, PageMode pages = PAGES_SMALL);
+
+	/* same contract as search() export */
+	int32_t search(const Rect &rect, const int32_t count, Point *out_points) const;
+
+	/* bytes of memory used by the index */
+	size_t memoryUsed(void) const;
+
+	/* number of levels with y structures */
+	size_t levelCount(void) const { return levels.size(); }
+
+	/* adds every array of the tree to report, prefaulting and locking them as asked */
+	void report(PageReport &report, bool prefault, bool lock) const;
+
+	/* release memory used by the index */
+	void clear(void);
+
+	/* y sorted Points of all nodes at one depth of the tree, with range minimum structure, viewing that
+	   depth's slice of the tree's level arrays */
+	struct Level {
+		const float *ys;              /* y of each Point, sorted within each node        */
+		const uint32_t *ids;          /* rank order position of each Point                */
+		const uint32_t *table;        /* sparse table of block holding lowest id, per power of 2 span */
+		size_t blocks;                /* RANGE_RMQ_BLOCK sized blocks per span row        */
+
+		/* position within [l,r) of lowest id, range must not be empty */
+		uint32_t minPosition(uint32_t l, uint32_t r) const;
+	};
+
+private:
+	/* not copyable */
+	RangeTree(const RangeTree &);
+	RangeTree &operator=(const RangeTree &);
+
+	size_t count;                      /* total Points                                  */
+	size_t leafSize;                   /* most Points in a leaf                         */
+	AlignedArray<Point> byRank;        /* Points sorted by rank                         */
+	AlignedArray<float> xs;            /* x of Points sorted by x                       */
+	AlignedArray<uint32_t> xIds;       /* rank order position of Points sorted by x     */
+	AlignedArray<float> levelYs;       /* ys of every level, count per level            */
+	AlignedArray<uint32_t> levelIds;   /* ids of every level, count per level           */
+	AlignedArray<uint32_t> levelTables;/* tables of every level, same size per level    */
+	std::vector<Level> levels;         /* y structures for each depth with internal nodes */
+};
+
+#endif /* __RANGE_TREE__ */
@@ -0,0 +1,147 @@
+#pragma once
+#ifndef __RANK_MERGE__
+#define __RANK_MERGE__
+
+#include <stddef.h>
+#include "point_search.h"
+#include "point_columns.h"
+#include "filter_kernels.h"
+#include <algorithm> /* for heap functions */
+
+/* Helpers shared by the indexes that keep runs of Points sorted by rank (blocks, grid cells) and
+   need to merge the matches of several runs into a single lowest rank first result, or that collect
+   the best matches of a tree in a bounded heap (k-d tree, quadtree). */
+
+/* orders Points from smallest to largest rank */
+struct PointRankLess {
+	bool operator()(const Point &a, const Point &b) const { return a.rank < b.rank; }
+};
+
+/* does Point lie within specified rect? tests are not short-circuited to avoid hard to predict branches */
+static inline bool inRect(const Point &p, const Rect &rect)
+{
+	return (p.x >= rect.lx) & (p.x <= rect.hx) & (p.y >= rect.ly) & (p.y <= rect.hy);
+}
+
+/* position within a rank sorted run of Points that still may supply matches during a search */
+struct RankCursor {
+	const Point *cur;  /* next matching Point                                  */
+	const Point *end;  /* one past last Point in run                            */
+	bool inside;       /* run lies entirely within rect, so every Point matches */
+};
+
+/* moves cursor forward to next Point within rect, returns false if run has no more matches */
+static inline bool advance(RankCursor &c, const Rect &rect)
+{
+	if (c.inside) return c.cur < c.end;
+	while ((c.cur < c.end) && !inRect(*c.cur, rect)) ++c.cur;
+	return c.cur < c.end;
+}
+
+/* restores heap order for cursor at index i moving down, smallest rank at top */
+static inline void siftDown(RankCursor *heap, size_t size, size_t i)
+{
+	RankCursor c = heap[i];
+	for (;;)
+	{
+		size_t child = 2 * i + 1;
+		if (child >= size) break;
+		if ((child + 1 < size) && (heap[child + 1].cur->rank < heap[child].cur->rank)) child++;
+		if (c.cur->rank <= heap[child].cur->rank) break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = c;
+}
+
+/* merges the matches of size cursors (each already positioned on a match) by rank into out_points
+   until count Points have been found, returns updated number of matches */
+static inline int32_t mergeByRank(RankCursor *heap, size_t size, const Rect &rect, int32_t matches, const int32_t count, Point *out_points)
+{
+	for (size_t i = size / 2; i-- > 0; ) siftDown(heap, size, i);
+	while ((size > 0) && (matches < count))
+	{
+		RankCursor &top = heap[0];
+		out_points[matches++] = *top.cur;
+		++top.cur;
+		if (!advance(top, rect)) top = heap[--size];
+		if (size > 0) siftDown(heap, size, 0);
+	}
+	return matches;
+}
+
+/* position within a rank sorted run of Points held in PointColumns, as RankCursor */
+struct ColumnCursor {
+	size_t cur;        /* next matching Point                                  */
+	size_t end;        /* one past last Point in run                            */
+	bool inside;       /* run lies entirely within rect, so every Point matches */
+};
+
+/* moves ColumnCursors forward to the next Point within rect using the selected filter kernel */
+struct ColumnFilter {
+	const PointColumns *columns;
+	Rect rect;
+	FindMatchFunc findMatch;
+
+	/* returns false if run has no more matches */
+	inline bool advance(ColumnCursor &c) const
+	{
+		if (c.inside) return c.cur < c.end;
+		c.cur = findMatch(columns->xs.data(), columns->ys.data(), c.cur, c.end, rect);
+		return c.cur < c.end;
+	}
+};
+
+/* restores heap order for cursor (any with cur field indexing ranks) at index i moving down, smallest rank at top */
+template <typename Cursor>
+static inline void siftDown(Cursor *heap, size_t size, size_t i, const int32_t *ranks)
+{
+	Cursor c = heap[i];
+	for (;;)
+	{
+		size_t child = 2 * i + 1;
+		if (child >= size) break;
+		if ((child + 1 < size) && (ranks[heap[child + 1].cur] < ranks[heap[child].cur])) child++;
+		if (ranks[c.cur] <= ranks[heap[child].cur]) break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = c;
+}
+
+/* as mergeByRank above, for runs held in PointColumns with filter moving cursors to their next match,
+   only matches are reassembled into Points */
+template <typename Cursor, typename Filter>
+static inline int32_t mergeByRank(Cursor *heap, size_t size, const PointColumns &columns, const Filter &filter, int32_t matches, const int32_t count, Point *out_points)
+{
+	const int32_t *ranks = columns.ranks.data();
+	for (size_t i = size / 2; i-- > 0; ) siftDown(heap, size, i, ranks);
+	while ((size > 0) && (matches < count))
+	{
+		Cursor &top = heap[0];
+		out_points[matches++] = columns.point(top.cur);
+		++top.cur;
+		if (!filter.advance(top)) top = heap[--size];
+		if (size > 0) siftDown(heap, size, 0, ranks);
+	}
+	return matches;
+}
+
+/* adds p to max heap of best matches in out_points (worst on top) if it improves on them */
+static inline void keepBest(const Point &p, Point *out_points, int32_t &matches, const int32_t count)
+{
+	PointRankLess rankLess;
+	if (matches < count)
+	{
+		out_points[matches++] = p;
+		std::push_heap(out_points, out_points + matches, rankLess);
+	}
+	else if (p.rank < out_points[0].rank)
+	{
+		std::pop_heap(out_points, out_points + matches, rankLess);
+		out_points[matches - 1] = p;
+		std::push_heap(out_points, out_points + matches, rankLess);
+	}
+}
+
+#endif /* __RANK_MERGE__ */
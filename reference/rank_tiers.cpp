@@ -0,0 +1,57 @@
+#include "rank_tiers.h"
+
+
+RankTiers::RankTiers(void)
+{
+	tierTotal = 0;
+}
+
+/* build tiers over a copy of points, which must be sorted by rank, tiers are built on up to threads threads
+   backed by pages of at best the requested mode, returns false (leaving no tiers) if out of memory */
+bool RankTiers::build(const Point *points, size_t count, size_t firstTier, size_t growth, size_t leafSize, size_t threads, PageMode pages)
+{
+	clear();
+	if (firstTier == 0) firstTier = DEFAULT_TIER_POINTS;
+	if (growth < 2) growth = DEFAULT_TIER_GROWTH;
+
+	std::vector<size_t> starts;
+	size_t size = firstTier;
+	for (size_t begin = 0; begin < count; )
+	{
+		/* last tier takes whatever is left rather than leaving a tiny remainder */
+		size_t end = ((count - begin) / growth <= size) ? count : begin + size;
+		starts.push_back(begin);
+		begin = end;
+		size *= growth;
+	}
+	starts.push_back(count);
+
+	/* the last tier holds most of the Points, so rather than a tier per thread every tier is split across all threads */
+	tierTotal = starts.size() - 1;
+	for (size_t tier = 0; tier < tierTotal; tier++)
+		if (!tiers[tier].build(points + starts[tier], starts[tier + 1] - starts[tier], leafSize, threads, pages))
+		{
+			clear();
+			return false;
+		}
+	return true;
+}
+
+/* same contract as search() export */
+int32_t RankTiers::search(const Rect &rect, const int32_t count, Point *out_points) const
+{
+	if ((rect.lx > rect.hx) || (rect.ly > rect.hy)) return 0;
+
+	/* each tier's matches all rank lower than the next tier's, so results simply follow one another */
+	int32_t matches = 0;
+	for (size_t tier = 0; (tier < tierTotal) && (matches < count); tier++)
+		matches += tiers[tier].search(rect, count - matches, out_points + matches);
+	return matches;
+}
+
+/* release memory used by the index */
+void RankTiers::clear(void)
+{
+	for (size_t tier = 0; tier < tierTotal; tier++) tiers[tier].clear();
+	tierTotal = 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#ifndef __RANK_TIERS__
+#define __RANK_TIERS__
+
+#include <stddef.h>
+#include <vector>
+#include "point_search.h"
+#include "kd_tree.h"
+
+/* default Points in the first (lowest ranked) tier, small enough to stay in L1/L2 cache */
+#define DEFAULT_TIER_POINTS 4096
+/* default factor each tier grows by over the one before it */
+#define DEFAULT_TIER_GROWTH 4
+/* most tiers, each at least twice the one before */
+#define MAX_RANK_TIERS 64
+
+/* Log-structured rank tiers: the rank sorted Points are cut into geometrically growing tiers (the best
+   4K, the next 16K, the next 64K, ...) and each tier gets its own k-d tree sized to it.  Every rank in a
+   tier is lower than every rank in the next, so a search takes the tiers in order and is finished as
+   soon as count matches are found; the large tail tiers are only touched by rects too sparse to be
+   answered by the hot ones. */
+class RankTiers
+{
+public:
+	RankTiers(void);
+
+	/* build tiers over a copy of points, which must be sorted by rank, tiers are built on up to threads threads
+	   backed by pages of at best the requested mode, returns false (leaving no tiers) if out of memory */
+	bool build(const Point *points, size_t count, size_t firstTier = DEFAULT_TIER_POINTS, size_t growth = DEFAULT_TIER_GROWTH, size_t leafSize = DEFAULT_KD_LEAF_SIZE,
+		size_t threads = 1, PageMode pages = PAGES_SMALL);
+
+	/* same contract as search() export */
+	int32_t search(const Rect &rect, const int32_t count, Point *out_points) const;
+
+	/* number of tiers built */
+	size_t tierCount(void) const { return tierTotal; }
+
+	/* appends the Points of every tier to out */
+	void copyPoints(std::vector<Point> &out) const { for (size_t i = 0; i < tierTotal; i++) tiers[i].copyPoints(out); }
+
+	/* adds the arrays of every tier to report, prefaulting and locking them as asked */
+	void report(PageReport &report, bool prefault, bool lock) const { for (size_t i = 0; i < tierTotal; i++) tiers[i].report(report, prefault, lock); }
+
+	/* release memory used by the index */
+	void clear(void);
+
+private:
+	KdTree tiers[MAX_RANK_TIERS];  /* spatial index of each tier, lowest ranks first */
+	size_t tierTotal;              /* tiers used                                     */
+};
+
+#endif /* __RANK_TIERS__ */
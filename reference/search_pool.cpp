@@ -0,0 +1,83 @@
+#include "search_pool.h"
+
+
+SearchPool::SearchPool(void) : task(NULL), parts(0), next(0), active(0), generation(0), stopping(false), busy(false)
+{
+}
+
+SearchPool::~SearchPool(void)
+{
+	stop();
+}
+
+/* starts workers, the thread calling run() is one more */
+void SearchPool::start(size_t workers)
+{
+	stop();
+	stopping = false;
+	for (size_t i = 0; i < workers; i++) threads.push_back(std::thread(&SearchPool::work, this));
+}
+
+/* stops and joins workers */
+void SearchPool::stop(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+	threads.clear();
+}
+
+/* takes parts of current run until none are left */
+void SearchPool::takeParts(void)
+{
+	for (size_t part; (part = next++) < parts; ) (*task)(part);
+}
+
+/* worker thread, takes parts of each run until stopped */
+void SearchPool::work(void)
+{
+	unsigned seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && (generation == seen)) wake.wait(lock);
+			if (stopping) return;
+			seen = generation;
+		}
+		takeParts();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--active == 0) done.notify_one();
+		}
+	}
+}
+
+/* runs task(part) for every part in [0,parts) on the workers and the calling thread */
+bool SearchPool::run(size_t parts, const std::function<void(size_t)> &task)
+{
+	bool expected = false;
+	if (!busy.compare_exchange_strong(expected, true)) return false;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		this->parts = parts;
+		next = 0;
+		active = threads.size();
+		generation++;
+	}
+	wake.notify_all();
+	takeParts();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (active > 0) done.wait(lock);
+		this->task = NULL;
+	}
+
+	busy = false;
+	return true;
+}
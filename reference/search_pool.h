@@ -0,0 +1,60 @@
+#pragma once
+#ifndef __SEARCH_POOL__
+#define __SEARCH_POOL__
+
+#include <stddef.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/* Persistent worker threads owned by a SearchContext so a single large search can fan out without
+   paying thread creation per query.  One fan-out runs at a time; a search arriving while the pool is
+   busy with another is told so and runs on its own thread instead of waiting, so the mutex below is
+   only ever taken by the one caller owning the pool and its workers. */
+class SearchPool
+{
+public:
+	SearchPool(void);
+	~SearchPool(void);
+
+	/* starts workers, the thread calling run() is one more */
+	void start(size_t workers);
+
+	/* stops and joins workers */
+	void stop(void);
+
+	/* number of worker threads */
+	size_t size(void) const { return threads.size(); }
+
+	/* runs task(part) for every part in [0,parts) on the workers and the calling thread, returns once all
+	   parts are done, or false without running anything if the pool is busy with another caller */
+	bool run(size_t parts, const std::function<void(size_t)> &task);
+
+private:
+	/* not copyable */
+	SearchPool(const SearchPool &);
+	SearchPool &operator=(const SearchPool &);
+
+	/* worker thread, takes parts of each run until stopped */
+	void work(void);
+
+	/* takes parts of current run until none are left */
+	void takeParts(void);
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;          /* a run started, or stopping             */
+	std::condition_variable done;          /* last worker left the current run        */
+	const std::function<void(size_t)> *task;
+	size_t parts;
+	std::atomic<size_t> next;              /* next part to take                        */
+	size_t active;                         /* workers still in the current run         */
+	unsigned generation;                   /* bumped for every run                     */
+	bool stopping;
+	std::atomic<bool> busy;                /* a caller owns the pool                   */
+};
+
+#endif /* __SEARCH_POOL__ */
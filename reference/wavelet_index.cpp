@@ -0,0 +1,559 @@
+#include "wavelet_index.h"
+#include "rank_merge.h"
+#include "parallel_sort.h"
+#include <algorithm> /* for std::sort, heap functions */
+#include <limits.h>  /* for INT32_MAX */
+#include <string.h>  /* for memcpy, memset */
+#ifdef _MSC_VER
+#include <intrin.h>  /* for __popcnt64, _BitScanForward64 */
+#endif
+
+
+/* number of one bits in w */
+static inline uint32_t popcount64(uint64_t w)
+{
+#ifdef _MSC_VER
+	return (uint32_t)__popcnt64(w);
+#else
+	return (uint32_t)__builtin_popcountll(w);
+#endif
+}
+
+/* position of lowest one bit in w, w must not be 0 */
+static inline uint32_t lowestBit(uint64_t w)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, w);
+	return (uint32_t)index;
+#else
+	return (uint32_t)__builtin_ctzll(w);
+#endif
+}
+
+/* key of v ordered as floats are, -0 just below +0, NaNs beyond the infinities of their sign */
+static inline uint32_t floatKey(float v)
+{
+	uint32_t u;
+	memcpy(&u, &v, sizeof(u));
+	return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+/* float of key k, inverse of floatKey */
+static inline float keyFloat(uint32_t k)
+{
+	uint32_t u = (k & 0x80000000u) ? (k & 0x7FFFFFFFu) : ~k;
+	float v;
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+
+/* orders Points by x key, ties by rank */
+struct WaveletXLess {
+	bool operator()(const Point &a, const Point &b) const
+	{
+		uint32_t ka = floatKey(a.x), kb = floatKey(b.x);
+		return (ka < kb) || ((ka == kb) && (a.rank < b.rank));
+	}
+};
+/* orders x order positions by y key of their Point, ties by rank */
+struct WaveletYLess {
+	const Point *points;
+	bool operator()(uint32_t a, uint32_t b) const
+	{
+		uint32_t ka = floatKey(points[a].y), kb = floatKey(points[b].y);
+		return (ka < kb) || ((ka == kb) && (points[a].rank < points[b].rank));
+	}
+};
+
+/* node of the wavelet matrix waiting to be expanded, lowest bound first */
+struct WaveletNode {
+	int32_t lowerBound;  /* no Point of node ranks lower                    */
+	uint32_t level;      /* level of range, levels.size() when a single value */
+	uint32_t s, e;       /* positions [s,e) within level                      */
+	uint64_t prefix;     /* y rank bits already decided                       */
+	bool operator<(const WaveletNode &other) const { return lowerBound > other.lowerBound; }
+};
+
+
+/* sizes for bits positions all 0, returns false if out of memory */
+bool WaveletIndex::BitVector::resize(size_t bits)
+{
+	if (!words.resize((bits + 63) / 64) || !ranks.resize(bits / WAVELET_SUPER_BITS + 1))
+	{
+		clear();
+		return false;
+	}
+	if (!words.empty()) memset(words.data(), 0, words.size() * sizeof(uint64_t));
+	zeros = (uint32_t)bits;
+	return true;
+}
+
+/* fills the rank directory and zeros once every bit is set */
+void WaveletIndex::BitVector::index(size_t bits)
+{
+	uint32_t ones = 0;
+	for (size_t sb = 0; sb < ranks.size(); sb++)
+	{
+		ranks[sb] = ones;
+		for (size_t w = sb * (WAVELET_SUPER_BITS / 64); (w < (sb + 1) * (WAVELET_SUPER_BITS / 64)) && (w < words.size()); w++)
+			ones += popcount64(words[w]);
+	}
+	zeros = (uint32_t)bits - ones;
+}
+
+/* ones in positions [0,i) */
+uint32_t WaveletIndex::BitVector::rank1(uint32_t i) const
+{
+	uint32_t r = ranks[i / WAVELET_SUPER_BITS];
+	for (uint32_t w = (i / WAVELET_SUPER_BITS) * (WAVELET_SUPER_BITS / 64); w < i / 64; w++) r += popcount64(words[w]);
+	if (i & 63) r += popcount64(words[i / 64] & ((1ull << (i & 63)) - 1));
+	return r;
+}
+
+/* position of k'th (from 0) one or zero bit */
+uint32_t WaveletIndex::BitVector::select(uint32_t k, bool one) const
+{
+	/* last directory entry with fewer than k+1 matching bits before it */
+	size_t lo = 0, hi = ranks.size() - 1;
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi + 1) / 2;
+		uint32_t before = one ? ranks[mid] : (uint32_t)(mid * WAVELET_SUPER_BITS) - ranks[mid];
+		if (before <= k) lo = mid; else hi = mid - 1;
+	}
+	k -= one ? ranks[lo] : (uint32_t)(lo * WAVELET_SUPER_BITS) - ranks[lo];
+
+	/* then word by word, and bit by bit within the word */
+	for (size_t w = lo * (WAVELET_SUPER_BITS / 64); ; w++)
+	{
+		uint64_t bits = one ? words[w] : ~words[w];
+		uint32_t n = popcount64(bits);
+		if (k < n)
+		{
+			for (; k > 0; k--) bits &= bits - 1;
+			return (uint32_t)(w * 64) + lowestBit(bits);
+		}
+		k -= n;
+	}
+}
+
+/* release memory */
+void WaveletIndex::BitVector::clear(void)
+{
+	words.clear();
+	ranks.clear();
+	zeros = 0;
+}
+
+
+/* codes count keys, which must be nondecreasing, returns false if out of memory */
+bool WaveletIndex::SortedFloats::build(const uint32_t *keys, size_t count)
+{
+	clear();
+	if (count == 0) return true;
+
+	/* low bits so that the high parts average about one per element, their unary code then takes about 2 bits each */
+	lowBits = 0;
+	while ((lowBits < 31) && (((uint64_t)count << (lowBits + 1)) <= ((uint64_t)1 << 32))) lowBits++;
+	size_t highs = (size_t)(0xFFFFFFFFu >> lowBits) + 1;
+	if (!high.resize(count + highs) || !low.resize(((uint64_t)count * lowBits + 63) / 64 + 1))
+	{
+		clear();
+		return false;
+	}
+	memset(low.data(), 0, low.size() * sizeof(uint64_t));
+	this->count = count;
+	uint64_t mask = (lowBits > 0) ? (((uint64_t)1 << lowBits) - 1) : 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		high.set((size_t)(keys[i] >> lowBits) + i);
+		uint64_t bit = (uint64_t)i * lowBits, value = keys[i] & mask;
+		if (value == 0) continue;
+		low[(size_t)(bit / 64)] |= value << (bit & 63);
+		if ((bit & 63) + lowBits > 64) low[(size_t)(bit / 64) + 1] |= value >> (64 - (bit & 63));
+	}
+	high.index(count + highs);
+	return true;
+}
+
+/* low bits of element i */
+static inline uint32_t lowPart(const AlignedArray<uint64_t> &low, uint32_t lowBits, size_t i)
+{
+	if (lowBits == 0) return 0;
+	uint64_t bit = (uint64_t)i * lowBits;
+	uint64_t value = low[(size_t)(bit / 64)] >> (bit & 63);
+	if ((bit & 63) + lowBits > 64) value |= low[(size_t)(bit / 64) + 1] << (64 - (bit & 63));
+	return (uint32_t)(value & (((uint64_t)1 << lowBits) - 1));
+}
+
+/* key of element i */
+uint32_t WaveletIndex::SortedFloats::key(size_t i) const
+{
+	uint32_t highPart = high.select((uint32_t)i, true) - (uint32_t)i;
+	return (uint32_t)(((uint64_t)highPart << lowBits) | lowPart(low, lowBits, i));
+}
+
+/* element i */
+float WaveletIndex::SortedFloats::at(size_t i) const
+{
+	return keyFloat(key(i));
+}
+
+/* first element not below v, or after the last at most v when inclusive; count if none */
+size_t WaveletIndex::SortedFloats::bound(float v, bool inclusive) const
+{
+	if (count == 0) return 0;
+	/* -0 and +0 are equal as floats but not as keys, so the bounds take in both */
+	uint64_t target = inclusive ? (uint64_t)floatKey((v == 0.0f) ? 0.0f : v) + 1 : floatKey((v == 0.0f) ? -0.0f : v);
+	if (target > 0xFFFFFFFFu) return count;
+
+	/* elements of lower high parts all come before the (h-1)'th zero, then scan those sharing high part h */
+	uint32_t h = (uint32_t)(target >> lowBits), targetLow = (uint32_t)target & (uint32_t)((((uint64_t)1 << lowBits) - 1));
+	size_t pos = (h == 0) ? 0 : (size_t)high.select(h - 1, false) + 1;
+	size_t i = pos - h;
+	for (; (i < count) && high.get((uint32_t)pos); i++, pos++)
+		if (lowPart(low, lowBits, i) >= targetLow) break;
+	return i;
+}
+
+/* release memory */
+void WaveletIndex::SortedFloats::clear(void)
+{
+	high.clear();
+	low.clear();
+	lowBits = 0;
+	count = 0;
+}
+
+
+/* lower bound on the lowest rank of the Points at positions [s,e), range must not be empty */
+int32_t WaveletIndex::Level::lowerBound(uint32_t s, uint32_t e) const
+{
+	size_t a = s / WAVELET_MIN_BLOCK, b = (e - 1) / WAVELET_MIN_BLOCK;
+	int32_t best = INT32_MAX;
+	for (size_t tier = 0; ; tier++)
+	{
+		const int32_t *m = &minRanks[tierStart[tier]];
+		if ((b - a + 1 < 2 * WAVELET_MIN_FANOUT) || (tier + 2 == tierStart.size()))
+		{
+			for (size_t i = a; i <= b; i++) if (m[i] < best) best = m[i];
+			return best;
+		}
+
+		/* partial groups at both ends here, whole groups in the tier above */
+		size_t na = (a + WAVELET_MIN_FANOUT - 1) / WAVELET_MIN_FANOUT;
+		size_t nb = (b + 1) / WAVELET_MIN_FANOUT - 1;
+		for (size_t i = a; i < na * WAVELET_MIN_FANOUT; i++) if (m[i] < best) best = m[i];
+		for (size_t i = (nb + 1) * WAVELET_MIN_FANOUT; i <= b; i++) if (m[i] < best) best = m[i];
+		a = na;
+		b = nb;
+	}
+}
+
+
+WaveletIndex::WaveletIndex(void)
+{
+	clear();
+}
+
+/* build index over points (any order), which need only stay valid during the call, returns false
+   (leaving the index empty) if out of memory */
+bool WaveletIndex::build(const Point *points, size_t count, size_t threads)
+{
+	clear();
+	if (count == 0) return true;
+
+	/* x order, keeping only rank and id of each Point plainly */
+	std::vector<Point> byX(points, points + count);
+	parallelSort(&byX[0], count, WaveletXLess(), threads);
+	std::vector<uint32_t> keys(count);
+	for (size_t i = 0; i < count; i++) keys[i] = floatKey(byX[i].x);
+	bool ok = xs.build(&keys[0], count) && ranks.resize(count) && ids.resize(count);
+
+	/* y rank of each Point, y in y order */
+	std::vector<uint32_t> byY(count);
+	for (size_t i = 0; i < count; i++) byY[i] = (uint32_t)i;
+	WaveletYLess yLess = { &byX[0] };
+	parallelSort(&byY[0], count, yLess, threads);
+	std::vector<uint32_t> values(count), nextValues(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		values[byY[i]] = (uint32_t)i;
+		keys[i] = floatKey(byX[byY[i]].y);
+	}
+	ok = ok && ys.build(&keys[0], count);
+	std::vector<uint32_t>().swap(byY);
+	std::vector<uint32_t>().swap(keys);
+
+	/* ranks follow the values through each level */
+	std::vector<int32_t> levelRanks(count), nextRanks(count);
+	for (size_t i = 0; ok && (i < count); i++)
+	{
+		levelRanks[i] = ranks[i] = byX[i].rank;
+		ids[i] = byX[i].id;
+	}
+	std::vector<Point>().swap(byX);
+
+	size_t bits = 1;
+	while ((bits < WAVELET_MAX_LEVELS) && (((size_t)1 << bits) < count)) bits++;
+	/* passes over a level are split into slices of whole blocks, so no two slices share a word of bits */
+	size_t blocks = (count + WAVELET_MIN_BLOCK - 1) / WAVELET_MIN_BLOCK;
+	size_t slices = (threads > 1) ? std::min(blocks, threads * WAVELET_SLICES_PER_THREAD) : 1;
+	for (size_t level = 0; ok && (level < bits); level++)
+	{
+		Level &l = levels[level];
+		uint32_t bit = (uint32_t)(bits - 1 - level);
+
+		/* lower bounds on rank, tier 0 per block then each tier over groups of the one below */
+		l.tierStart.assign(1, 0);
+		for (size_t size = (count + WAVELET_MIN_BLOCK - 1) / WAVELET_MIN_BLOCK; ; size = (size + WAVELET_MIN_FANOUT - 1) / WAVELET_MIN_FANOUT)
+		{
+			l.tierStart.push_back(l.tierStart.back() + size);
+			if (size <= 1) break;
+		}
+		if (!l.minRanks.resize(l.tierStart.back()) || !l.bits.resize(count))
+		{
+			ok = false;
+			break;
+		}
+		for (size_t i = 0; i < l.minRanks.size(); i++) l.minRanks[i] = INT32_MAX;
+
+		/* bit vector of this bit of each value, and the lowest rank of each block */
+		parallelFor(threads, slices, [&](size_t slice) {
+			for (size_t i = partStart(blocks, slices, slice) * WAVELET_MIN_BLOCK, iEnd = std::min(count, partStart(blocks, slices, slice + 1) * WAVELET_MIN_BLOCK); i < iEnd; i++)
+			{
+				if ((values[i] >> bit) & 1) l.bits.set(i);
+				if (levelRanks[i] < l.minRanks[i / WAVELET_MIN_BLOCK]) l.minRanks[i / WAVELET_MIN_BLOCK] = levelRanks[i];
+			}
+		});
+		l.bits.index(count);
+		levelTotal = level + 1;
+
+		/* each tier of bounds above over groups of the one below */
+		for (size_t tier = 1; tier + 1 < l.tierStart.size(); tier++)
+		{
+			const int32_t *below = &l.minRanks[l.tierStart[tier - 1]];
+			int32_t *above = &l.minRanks[l.tierStart[tier]];
+			for (size_t i = 0; i < l.tierStart[tier] - l.tierStart[tier - 1]; i++)
+				if (below[i] < above[i / WAVELET_MIN_FANOUT]) above[i / WAVELET_MIN_FANOUT] = below[i];
+		}
+
+		/* stable partition, zeros first, gives the order of the next level, the rank directory telling each slice where to write */
+		parallelFor(threads, slices, [&](size_t slice) {
+			uint32_t i = (uint32_t)(partStart(blocks, slices, slice) * WAVELET_MIN_BLOCK);
+			uint32_t iEnd = (uint32_t)std::min(count, partStart(blocks, slices, slice + 1) * WAVELET_MIN_BLOCK);
+			size_t zero = l.bits.rank0(i), one = l.bits.zeros + l.bits.rank1(i);
+			for (; i < iEnd; i++)
+			{
+				size_t to = ((values[i] >> bit) & 1) ? one++ : zero++;
+				nextValues[to] = values[i];
+				nextRanks[to] = levelRanks[i];
+			}
+		});
+		values.swap(nextValues);
+		levelRanks.swap(nextRanks);
+	}
+	if (!ok)
+	{
+		clear();
+		return false;
+	}
+	this->count = count;
+	return true;
+}
+
+/* x order position of the Point at position p of level */
+uint32_t WaveletIndex::trace(size_t level, uint32_t p) const
+{
+	while (level-- > 0)
+	{
+		const BitVector &bits = levels[level].bits;
+		p = (p < bits.zeros) ? bits.select(p, false) : bits.select(p - bits.zeros, true);
+	}
+	return p;
+}
+
+/* y rank of the Point at position p of level, whose y ranks start with the level bits of prefix */
+uint32_t WaveletIndex::descend(size_t level, uint32_t p, uint64_t prefix) const
+{
+	for (; level < levelTotal; level++)
+	{
+		const BitVector &bv = levels[level].bits;
+		uint32_t ones = bv.rank1(p);
+		if (bv.get(p))
+		{
+			prefix = prefix * 2 + 1;
+			p = bv.zeros + ones;
+		}
+		else
+		{
+			prefix = prefix * 2;
+			p = p - ones;
+		}
+	}
+	return (uint32_t)prefix;
+}
+
+/* Point at x order position p with y rank r */
+Point WaveletIndex::pointAt(uint32_t p, uint32_t r) const
+{
+	Point point;
+	point.id = ids[p];
+	point.rank = ranks[p];
+	point.x = xs.at(p);
+	point.y = ys.at(r);
+	return point;
+}
+
+/* number of x order positions [s,e) with y rank below v */
+uint32_t WaveletIndex::countBelow(uint32_t s, uint32_t e, uint64_t v) const
+{
+	const uint32_t bits = (uint32_t)levelTotal;
+	if (v >= ((uint64_t)1 << bits)) return e - s;
+	uint32_t below = 0;
+	for (uint32_t level = 0; (level < bits) && (s < e); level++)
+	{
+		const BitVector &bv = levels[level].bits;
+		uint32_t s0 = bv.rank0(s), e0 = bv.rank0(e);
+		if ((v >> (bits - 1 - level)) & 1)
+		{
+			/* every value with a 0 here is below v */
+			below += e0 - s0;
+			s = bv.zeros + (s - s0);
+			e = bv.zeros + (e - e0);
+		}
+		else
+		{
+			s = s0;
+			e = e0;
+		}
+	}
+	return below;
+}
+
+/* exact number of Points inside rect, O(log^2 n) */
+size_t WaveletIndex::countIn(const Rect &rect) const
+{
+	if (count == 0) return 0;
+	if (!(rect.lx <= rect.hx) || !(rect.ly <= rect.hy)) return 0;
+
+	uint32_t xb = (uint32_t)xs.bound(rect.lx, false), xe = (uint32_t)xs.bound(rect.hx, true);
+	if (xb >= xe) return 0;
+	uint32_t ya = (uint32_t)ys.bound(rect.ly, false), yb = (uint32_t)ys.bound(rect.hy, true);
+	if (ya >= yb) return 0;
+	return countBelow(xb, xe, yb) - countBelow(xb, xe, ya);
+}
+
+/* same contract as search() export */
+int32_t WaveletIndex::search(const Rect &rect, const int32_t count, Point *out_points) const
+{
+	if ((count <= 0) || (this->count == 0)) return 0;
+	if (!(rect.lx <= rect.hx) || !(rect.ly <= rect.hy)) return 0;
+
+	/* x range and y rank range [ya,yb) are both exact from the coded coordinates */
+	uint32_t xb = (uint32_t)xs.bound(rect.lx, false), xe = (uint32_t)xs.bound(rect.hx, true);
+	if (xb >= xe) return 0;
+	uint64_t ya = ys.bound(rect.ly, false), yb = ys.bound(rect.hy, true);
+	if (ya >= yb) return 0;
+
+	/* out_points doubles as a max heap on rank of best matches found, worst at top */
+	int32_t matches = 0;
+	const uint32_t bits = (uint32_t)levelTotal;
+
+	/* kept per thread (see KdTree::search) */
+	static thread_local std::vector<WaveletNode> heap;
+	heap.clear();
+	WaveletNode root = { levels[0].lowerBound(xb, xe), 0, xb, xe, 0 };
+	heap.push_back(root);
+
+	while (!heap.empty())
+	{
+		WaveletNode node = heap.front();
+		std::pop_heap(heap.begin(), heap.end());
+		heap.pop_back();
+
+		/* nothing left can improve on the count matches already found */
+		if ((matches >= count) && (node.lowerBound > out_points[0].rank)) break;
+
+		if ((node.e - node.s <= WAVELET_REPORT_SIZE) || (node.level == bits))
+		{
+			/* few enough Points to look each up, those of y ranks past the node's share of [ya,yb) are not inside */
+			for (uint32_t p = node.s; p < node.e; p++)
+			{
+				uint32_t r = descend(node.level, p, node.prefix);
+				if ((r < ya) || (r >= yb)) continue;
+				uint32_t x = trace(node.level, p);
+				if ((matches >= count) && (ranks[x] > out_points[0].rank)) continue;
+				keepBest(pointAt(x, r), out_points, matches, count);
+			}
+			continue;
+		}
+
+		/* split on next bit of y rank, keeping children whose values overlap [ya,yb) */
+		const BitVector &bv = levels[node.level].bits;
+		uint32_t s0 = bv.rank0(node.s), e0 = bv.rank0(node.e);
+		WaveletNode child[2];
+		child[0].s = s0;
+		child[0].e = e0;
+		child[1].s = bv.zeros + (node.s - s0);
+		child[1].e = bv.zeros + (node.e - e0);
+		uint32_t childBits = bits - node.level - 1;
+		for (int i = 0; i < 2; i++)
+		{
+			if (child[i].s >= child[i].e) continue;
+			child[i].prefix = node.prefix * 2 + i;
+			uint64_t vlo = child[i].prefix << childBits, vhi = (child[i].prefix + 1) << childBits;
+			if ((vhi <= ya) || (vlo >= yb)) continue;
+			child[i].level = node.level + 1;
+			child[i].lowerBound = (child[i].level < bits) ? levels[child[i].level].lowerBound(child[i].s, child[i].e) : node.lowerBound;
+			if ((matches >= count) && (child[i].lowerBound > out_points[0].rank)) continue;
+			heap.push_back(child[i]);
+			std::push_heap(heap.begin(), heap.end());
+		}
+	}
+
+	/* turn heap into lowest rank first order */
+	std::sort_heap(out_points, out_points + matches, PointRankLess());
+	return matches;
+}
+
+/* bytes of memory used by the index, all told */
+size_t WaveletIndex::memoryUsed(void) const
+{
+	size_t bytes = sizeof(*this) + xs.memoryUsed() + ys.memoryUsed() + ranks.size() * sizeof(int32_t) + ids.size() * sizeof(int8_t);
+	for (size_t level = 0; level < levelTotal; level++)
+		bytes += levels[level].bits.memoryUsed() + levels[level].minRanks.size() * sizeof(int32_t) + levels[level].tierStart.capacity() * sizeof(size_t);
+	return bytes;
+}
+
+/* adds every array of the index to report, prefaulting and locking them as asked */
+void WaveletIndex::report(PageReport &report, bool prefault, bool lock) const
+{
+	xs.report(report, prefault, lock);
+	ys.report(report, prefault, lock);
+	ranks.report(report, prefault, lock);
+	ids.report(report, prefault, lock);
+	for (size_t level = 0; level < levelTotal; level++)
+	{
+		levels[level].bits.report(report, prefault, lock);
+		levels[level].minRanks.report(report, prefault, lock);
+	}
+}
+
+/* release memory used by the index */
+void WaveletIndex::clear(void)
+{
+	count = 0;
+	xs.clear();
+	ys.clear();
+	ranks.clear();
+	ids.clear();
+	for (size_t level = 0; level < WAVELET_MAX_LEVELS; level++)
+	{
+		levels[level].bits.clear();
+		levels[level].minRanks.clear();
+		std::vector<size_t>().swap(levels[level].tierStart);
+	}
+	levelTotal = 0;
+}